@@ -1,10 +1,27 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : enable
 
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragUV;
 
 layout(location = 0) out vec4 outColor;
 
+// bindless, draw.textureIndex picks the image
+layout(set = 0, binding = 0) uniform texture2D textures[];
+layout(set = 0, binding = 2) uniform sampler linearSampler;
+
+layout(push_constant) uniform Draw {
+    vec4 tint;
+    uint instanceBuffer;
+    uint textureIndex;
+} draw;
+
 void main() {
-    outColor = vec4(fragColor, 1.0);
+    vec3 color = fragColor;
+    // 0xFFFFFFFF: untextured
+    if(draw.textureIndex != 0xFFFFFFFFu)
+        color *= texture(sampler2D(textures[draw.textureIndex], linearSampler), fragUV).rgb;
+
+    outColor = vec4(color, 1.0);
 }
\ No newline at end of file
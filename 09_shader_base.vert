@@ -1,21 +1,42 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : enable
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
 
 layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragUV;
+
+struct Instance {
+    vec4 transform; // offset.xy, scale, rotation
+    vec4 color;
+};
+
+// bindless, draw.instanceBuffer picks the frame's instances
+layout(std430, set = 0, binding = 1) readonly buffer Instances {
+    Instance instances[];
+} buffers[];
 
-vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
+// from the uniform ring, bound with a dynamic offset per frame
+layout(std140, set = 1, binding = 0) uniform Frame {
+    vec4 view; // offset.xy, scale.xy
+    vec4 time; // seconds, delta seconds
+} frame;
 
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
+layout(push_constant) uniform Draw {
+    vec4 tint;
+    uint instanceBuffer;
+    uint textureIndex;
+} draw;
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
+    Instance inst = buffers[draw.instanceBuffer].instances[gl_InstanceIndex];
+
+    float c = cos(inst.transform.w), s = sin(inst.transform.w);
+    vec2 pos = mat2(c, s, -s, c) * inPosition * inst.transform.z + inst.transform.xy;
+
+    gl_Position = vec4((pos + frame.view.xy) * frame.view.zw, 0.0, 1.0);
+    fragColor = inColor * inst.color.rgb * draw.tint.rgb;
+    fragUV = inPosition * 0.5 + 0.5;
 }
\ No newline at end of file
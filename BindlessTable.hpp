@@ -0,0 +1,290 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// Bindless descriptors: every sampled image and storage buffer gets a stable index into one large
+// update-after-bind, partially bound set, shaders pick resources by the index they get through push constants.
+// binding 0: texture2D[], binding 1: storage buffers[], binding 2: an immutable linear sampler.
+// There is a copy of the set per frame slot, only written by flush() once the slot's frame has completed,
+// so an index can be pointed at a new resource while frames in flight still read the old one.
+class BindlessTable {
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    static constexpr uint32_t IMAGE_BINDING = 0, BUFFER_BINDING = 1, SAMPLER_BINDING = 2;
+
+    // of maxPerStageUpdateAfterBindResources, kept for everything but the two arrays
+    static constexpr uint32_t RESERVED_RESOURCES = 16;
+
+    // the counts get clamped to the device's update-after-bind limits, per type and in total
+    void init(VkDevice _device, const VkPhysicalDeviceVulkan12Properties & _props12, uint32_t _setCnt,
+        uint32_t _maxImages = 16384, uint32_t _maxBuffers = 4096) {
+        device_ = _device;
+
+        uint32_t imageCnt = std::min({ _maxImages, _props12.maxDescriptorSetUpdateAfterBindSampledImages,
+            _props12.maxPerStageDescriptorUpdateAfterBindSampledImages });
+        uint32_t bufferCnt = std::min({ _maxBuffers, _props12.maxDescriptorSetUpdateAfterBindStorageBuffers,
+            _props12.maxPerStageDescriptorUpdateAfterBindStorageBuffers });
+
+        // both arrays are visible to every stage, together they have to fit the per-stage total,
+        // with room left for the sampler, the other sets and the color attachments
+        uint32_t resourceCnt = _props12.maxPerStageUpdateAfterBindResources > RESERVED_RESOURCES
+            ? _props12.maxPerStageUpdateAfterBindResources - RESERVED_RESOURCES : 2;
+        if(uint64_t(imageCnt) + bufferCnt > resourceCnt) {
+            uint32_t scaledImageCnt = uint32_t(uint64_t(imageCnt) * resourceCnt / (uint64_t(imageCnt) + bufferCnt));
+            imageCnt = std::clamp(scaledImageCnt, 1U, resourceCnt - 1);
+            bufferCnt = std::min(bufferCnt, resourceCnt - imageCnt);
+        }
+
+        images_.init(imageCnt);
+        buffers_.init(bufferCnt);
+
+        VkSamplerCreateInfo samplerInfo = {
+            .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+            .magFilter = VK_FILTER_LINEAR,
+            .minFilter = VK_FILTER_LINEAR,
+            .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+            .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+            .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+            .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+            .anisotropyEnable = VK_FALSE,
+            .compareEnable = VK_FALSE,
+            .minLod = 0.0F,
+            .maxLod = VK_LOD_CLAMP_NONE,
+            .unnormalizedCoordinates = VK_FALSE
+        };
+
+        if(vkCreateSampler(device_, &samplerInfo, nullptr, &sampler_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create bindless sampler");
+
+        VkDescriptorSetLayoutBinding bindings[] = {
+            {
+                .binding = IMAGE_BINDING,
+                .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+                .descriptorCount = imageCnt,
+                .stageFlags = VK_SHADER_STAGE_ALL
+            }, {
+                .binding = BUFFER_BINDING,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = bufferCnt,
+                .stageFlags = VK_SHADER_STAGE_ALL
+            }, {
+                .binding = SAMPLER_BINDING,
+                .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_ALL,
+                .pImmutableSamplers = &sampler_
+            }
+        };
+
+        // unused entries may hold anything, writes don't wait for command buffers that bound the set
+        VkDescriptorBindingFlags bindingFlags[] = {
+            VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+            VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+            0
+        };
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+            .bindingCount = std::extent_v<decltype(bindingFlags)>,
+            .pBindingFlags = bindingFlags
+        };
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .pNext = &bindingFlagsInfo,
+            .flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+            .bindingCount = std::extent_v<decltype(bindings)>,
+            .pBindings = bindings
+        };
+
+        if(vkCreateDescriptorSetLayout(device_, &layoutInfo, nullptr, &layout_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create bindless descriptor set layout");
+
+        VkDescriptorPoolSize poolSizes[] = {
+            { .type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, .descriptorCount = imageCnt * _setCnt },
+            { .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = bufferCnt * _setCnt },
+            { .type = VK_DESCRIPTOR_TYPE_SAMPLER, .descriptorCount = _setCnt }
+        };
+
+        VkDescriptorPoolCreateInfo poolInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+            .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+            .maxSets = _setCnt,
+            .poolSizeCount = std::extent_v<decltype(poolSizes)>,
+            .pPoolSizes = poolSizes
+        };
+
+        if(vkCreateDescriptorPool(device_, &poolInfo, nullptr, &pool_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create bindless descriptor pool");
+
+        std::vector<VkDescriptorSetLayout> layouts(_setCnt, layout_);
+        VkDescriptorSetAllocateInfo allocInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = pool_,
+            .descriptorSetCount = _setCnt,
+            .pSetLayouts = layouts.data()
+        };
+
+        sets_.resize(_setCnt);
+        if(vkAllocateDescriptorSets(device_, &allocInfo, sets_.data()) != VK_SUCCESS)
+            throw std::runtime_error("Failed to allocate bindless descriptor sets");
+
+        dirty_.resize(_setCnt);
+    }
+
+    void destroy() noexcept {
+        vkDestroyDescriptorPool(device_, pool_, nullptr);
+        vkDestroyDescriptorSetLayout(device_, layout_, nullptr);
+        vkDestroySampler(device_, sampler_, nullptr);
+
+        pool_ = VK_NULL_HANDLE;
+        layout_ = VK_NULL_HANDLE;
+        sampler_ = VK_NULL_HANDLE;
+        sets_.clear();
+        dirty_.clear();
+    }
+
+    VkDescriptorSetLayout layout() const noexcept {
+        return layout_;
+    }
+
+    // _view in SHADER_READ_ONLY_OPTIMAL whenever a frame samples it
+    uint32_t addImage(VkImageView _view) {
+        uint32_t index = images_.allocate("sampled images");
+        setImage(index, _view);
+        return index;
+    }
+
+    void setImage(uint32_t _index, VkImageView _view) {
+        images_.infos[_index] = {
+            .sampler = VK_NULL_HANDLE,
+            .imageView = _view,
+            .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+        };
+        markDirty(IMAGE_BINDING, _index);
+    }
+
+    uint32_t addBuffer(VkBuffer _buffer, VkDeviceSize _offset = 0, VkDeviceSize _range = VK_WHOLE_SIZE) {
+        uint32_t index = buffers_.allocate("storage buffers");
+        setBuffer(index, _buffer, _offset, _range);
+        return index;
+    }
+
+    void setBuffer(uint32_t _index, VkBuffer _buffer, VkDeviceSize _offset = 0, VkDeviceSize _range = VK_WHOLE_SIZE) {
+        buffers_.infos[_index] = { .buffer = _buffer, .offset = _offset, .range = _range };
+        markDirty(BUFFER_BINDING, _index);
+    }
+
+    // the index is reused right away; frames in flight reading it are fine, their set copies aren't touched.
+    // the resource itself must outlive them
+    void removeImage(uint32_t _index) {
+        images_.release(_index);
+    }
+
+    void removeBuffer(uint32_t _index) {
+        buffers_.release(_index);
+    }
+
+    // writes what changed since the slot's last flush and returns its set, the slot's previous frame must have completed
+    VkDescriptorSet flush(uint32_t _slot) {
+        auto & dirty = dirty_[_slot];
+        if(!dirty.empty()) {
+            std::vector<VkWriteDescriptorSet> writes;
+            writes.reserve(dirty.size());
+
+            for(auto [binding, index] : dirty) {
+                VkWriteDescriptorSet write = {
+                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                    .dstSet = sets_[_slot],
+                    .dstBinding = binding,
+                    .dstArrayElement = index,
+                    .descriptorCount = 1
+                };
+
+                if(binding == IMAGE_BINDING) {
+                    write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+                    write.pImageInfo = &images_.infos[index];
+                } else {
+                    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                    write.pBufferInfo = &buffers_.infos[index];
+                }
+
+                writes.push_back(write);
+            }
+
+            vkUpdateDescriptorSets(device_, writes.size(), writes.data(), 0, nullptr);
+            writeCnt_ += writes.size();
+            dirty.clear();
+        }
+
+        return sets_[_slot];
+    }
+
+    void logStats(std::ostream & _out) const {
+        _out << "Bindless: " << images_.used() << " of " << images_.infos.size() << " images, "
+            << buffers_.used() << " of " << buffers_.infos.size() << " buffers, " << writeCnt_ << " descriptor writes\n";
+    }
+
+private:
+    // the latest info per index, indices are handed out from a free list
+    template<typename Info>
+    struct Table {
+        std::vector<Info> infos;
+        std::vector<uint32_t> freeList;
+
+        void init(uint32_t _cnt) {
+            infos.assign(_cnt, {});
+            freeList.resize(_cnt);
+            // lowest indices first
+            for(uint32_t i = 0; i< _cnt; ++i)
+                freeList[i] = _cnt - 1 - i;
+        }
+
+        uint32_t allocate(const char * _what) {
+            if(freeList.empty())
+                throw std::runtime_error(std::string("Out of bindless ") + _what);
+
+            uint32_t index = freeList.back();
+            freeList.pop_back();
+            return index;
+        }
+
+        void release(uint32_t _index) {
+            freeList.push_back(_index);
+        }
+
+        size_t used() const noexcept {
+            return infos.size() - freeList.size();
+        }
+    };
+
+    struct DirtyEntry {
+        uint32_t binding, index;
+    };
+
+    VkDevice device_ = VK_NULL_HANDLE;
+    VkSampler sampler_ = VK_NULL_HANDLE;
+    VkDescriptorSetLayout layout_ = VK_NULL_HANDLE;
+    VkDescriptorPool pool_ = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> sets_;
+
+    Table<VkDescriptorImageInfo> images_;
+    Table<VkDescriptorBufferInfo> buffers_;
+    // per slot, an index changed twice is written twice
+    std::vector<std::vector<DirtyEntry>> dirty_;
+    uint64_t writeCnt_ = 0;
+
+    void markDirty(uint32_t _binding, uint32_t _index) {
+        for(auto & dirty : dirty_)
+            dirty.push_back({ _binding, _index });
+    }
+};
@@ -0,0 +1,474 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "MemoryAllocator.hpp"
+
+// Data-parallel jobs on the device's compute queue, outside of the frame loop.
+// Dispatches go into one command buffer per submit, chained with a barrier only where a dispatch touches
+// a buffer that an earlier dispatch since the last barrier wrote, or writes one it read.
+// Not thread-safe; the compute queue may be the graphics queue, so submit from the render thread.
+class ComputeContext {
+public:
+    struct Pipeline {
+        VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        uint32_t bufferCnt = 0;
+        uint32_t pushConstantSize = 0;
+    };
+
+    // host-visible, filled and read back without staging
+    struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        MemoryAllocator::Allocation memory;
+        VkDeviceSize size = 0;
+    };
+
+    // storage buffer at binding = position in the dispatch's list
+    struct Binding {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        bool write = false;
+        VkDeviceSize offset = 0;
+        VkDeviceSize range = VK_WHOLE_SIZE;
+    };
+
+    struct Stats {
+        uint64_t submits = 0;
+        uint64_t dispatches = 0;
+        uint64_t barriers = 0;
+    };
+
+    // _cache may be VK_NULL_HANDLE
+    void init(VkDevice _device, MemoryAllocator & _allocator, uint32_t _queueFamily, VkQueue _queue,
+        VkPipelineCache _cache = VK_NULL_HANDLE) {
+        device_ = _device;
+        allocator_ = &_allocator;
+        queueFamily_ = _queueFamily;
+        queue_ = _queue;
+        cache_ = _cache;
+
+        VkCommandPoolCreateInfo poolInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+            .queueFamilyIndex = queueFamily_
+        };
+
+        if(vkCreateCommandPool(device_, &poolInfo, nullptr, &commandPool_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create compute command pool");
+
+        VkCommandBufferAllocateInfo allocInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = commandPool_,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1
+        };
+
+        if(vkAllocateCommandBuffers(device_, &allocInfo, &cmdBuf_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to allocate compute command buffer");
+
+        VkSemaphoreTypeCreateInfo timelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0
+        };
+
+        VkSemaphoreCreateInfo semaphoreInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &timelineInfo
+        };
+
+        // signaled with the submit number
+        if(vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &timeline_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create compute timeline semaphore");
+    }
+
+    // waits for the last submit, pipelines and buffers are the caller's
+    void destroy() noexcept {
+        if(device_ == VK_NULL_HANDLE)
+            return;
+
+        VkSemaphoreWaitInfo waitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .semaphoreCount = 1,
+            .pSemaphores = &timeline_,
+            .pValues = &submitCnt_
+        };
+        vkWaitSemaphores(device_, &waitInfo, UINT64_MAX);
+
+        for(auto pool : descriptorPools_)
+            vkDestroyDescriptorPool(device_, pool, nullptr);
+        descriptorPools_.clear();
+
+        vkDestroySemaphore(device_, timeline_, nullptr);
+        vkDestroyCommandPool(device_, commandPool_, nullptr);
+        device_ = VK_NULL_HANDLE;
+    }
+
+    // _bufferCnt storage buffers at bindings 0.., _pushConstantSize bytes of push constants
+    Pipeline createPipeline(std::span<const uint32_t> _spirv, uint32_t _bufferCnt, uint32_t _pushConstantSize = 0) {
+        Pipeline pipeline = { .bufferCnt = _bufferCnt, .pushConstantSize = _pushConstantSize };
+
+        std::vector<VkDescriptorSetLayoutBinding> bindings(_bufferCnt);
+        for(uint32_t i = 0; i< _bufferCnt; ++i) {
+            bindings[i] = {
+                .binding = i,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+            };
+        }
+
+        VkDescriptorSetLayoutCreateInfo setLayoutInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .bindingCount = _bufferCnt,
+            .pBindings = bindings.data()
+        };
+
+        if(vkCreateDescriptorSetLayout(device_, &setLayoutInfo, nullptr, &pipeline.setLayout) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create compute descriptor set layout");
+
+        VkPushConstantRange pushRange = {
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .offset = 0,
+            .size = _pushConstantSize
+        };
+
+        VkPipelineLayoutCreateInfo layoutInfo = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+            .setLayoutCount = 1,
+            .pSetLayouts = &pipeline.setLayout,
+            .pushConstantRangeCount = _pushConstantSize != 0 ? 1U : 0U,
+            .pPushConstantRanges = &pushRange
+        };
+
+        if(vkCreatePipelineLayout(device_, &layoutInfo, nullptr, &pipeline.layout) != VK_SUCCESS) {
+            destroyPipeline(pipeline);
+            throw std::runtime_error("Failed to create compute pipeline layout");
+        }
+
+        VkShaderModuleCreateInfo moduleInfo = {
+            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+            .codeSize = _spirv.size_bytes(),
+            .pCode = _spirv.data()
+        };
+
+        VkShaderModule module;
+        if(vkCreateShaderModule(device_, &moduleInfo, nullptr, &module) != VK_SUCCESS) {
+            destroyPipeline(pipeline);
+            throw std::runtime_error("Failed to create compute shader module");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = module,
+                .pName = "main"
+            },
+            .layout = pipeline.layout
+        };
+
+        auto res = vkCreateComputePipelines(device_, cache_, 1, &pipelineInfo, nullptr, &pipeline.pipeline);
+        vkDestroyShaderModule(device_, module, nullptr);
+
+        if(res != VK_SUCCESS) {
+            destroyPipeline(pipeline);
+            throw std::runtime_error("Failed to create compute pipeline");
+        }
+
+        return pipeline;
+    }
+
+    // no submit using it may be pending
+    void destroyPipeline(Pipeline & _pipeline) noexcept {
+        vkDestroyPipeline(device_, _pipeline.pipeline, nullptr);
+        vkDestroyPipelineLayout(device_, _pipeline.layout, nullptr);
+        vkDestroyDescriptorSetLayout(device_, _pipeline.setLayout, nullptr);
+        _pipeline = {};
+    }
+
+    // device-local where the host can write it directly (BAR/ReBAR/UMA), _data: _size bytes or nullptr
+    Buffer createBuffer(VkDeviceSize _size, const void * _data = nullptr, VkBufferUsageFlags _usage = 0) {
+        Buffer buffer = { .size = _size };
+
+        std::tie(buffer.buffer, buffer.memory) = allocator_->createBuffer(_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | _usage,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        if(_data != nullptr)
+            std::memcpy(buffer.memory.mapped, _data, _size);
+
+        return buffer;
+    }
+
+    // no submit using it may be pending
+    void destroyBuffer(Buffer & _buffer) noexcept {
+        if(_buffer.buffer != VK_NULL_HANDLE)
+            allocator_->destroyBuffer(_buffer.buffer, _buffer.memory);
+        _buffer = {};
+    }
+
+    // starts recording, dispatch() calls it when needed. waits for the previous submit, whose sets get recycled
+    VkCommandBuffer begin() {
+        if(recording_)
+            return cmdBuf_;
+
+        if(submitCnt_ != 0)
+            wait(submitCnt_);
+
+        vkResetCommandPool(device_, commandPool_, 0);
+        for(uint32_t i = 0; i< poolsUsed_; ++i)
+            vkResetDescriptorPool(device_, descriptorPools_[i], 0);
+        poolsUsed_ = 0;
+
+        VkCommandBufferBeginInfo beginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+        };
+
+        if(vkBeginCommandBuffer(cmdBuf_, &beginInfo) != VK_SUCCESS)
+            throw std::runtime_error("Failed to begin compute command buffer");
+
+        recording_ = true;
+        written_.clear();
+        read_.clear();
+        return cmdBuf_;
+    }
+
+    // _groupCnt workgroups, see groupCnt(). _pushConstants: the pipeline's pushConstantSize bytes
+    void dispatch(const Pipeline & _pipeline, std::initializer_list<Binding> _buffers,
+        uint32_t _groupCntX, uint32_t _groupCntY = 1, uint32_t _groupCntZ = 1, const void * _pushConstants = nullptr) {
+        if(_buffers.size() != _pipeline.bufferCnt)
+            throw std::runtime_error("Compute dispatch binds " + std::to_string(_buffers.size()) + " buffers, the pipeline has "
+                + std::to_string(_pipeline.bufferCnt));
+
+        begin();
+
+        // RAW and WAW need the writes made visible, WAR only the execution order; one barrier covers all of them
+        bool hazard = std::any_of(_buffers.begin(), _buffers.end(), [this](const Binding & _binding) {
+            return contains(written_, _binding.buffer) || (_binding.write && contains(read_, _binding.buffer));
+        });
+
+        if(hazard) {
+            VkMemoryBarrier barrier = {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+            };
+            vkCmdPipelineBarrier(cmdBuf_, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+            written_.clear();
+            read_.clear();
+            ++stats_.barriers;
+        }
+
+        for(const auto & binding : _buffers)
+            (binding.write ? written_ : read_).push_back(binding.buffer);
+
+        VkDescriptorSet set = allocateSet(_pipeline.setLayout);
+
+        std::vector<VkDescriptorBufferInfo> bufferInfos;
+        bufferInfos.reserve(_buffers.size());
+        for(const auto & binding : _buffers)
+            bufferInfos.push_back({ .buffer = binding.buffer, .offset = binding.offset, .range = binding.range });
+
+        VkWriteDescriptorSet write = {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = set,
+            .dstBinding = 0,
+            .dstArrayElement = 0,
+            .descriptorCount = static_cast<uint32_t>(bufferInfos.size()),
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = bufferInfos.data()
+        };
+        if(!bufferInfos.empty())
+            vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
+
+        vkCmdBindPipeline(cmdBuf_, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline.pipeline);
+        vkCmdBindDescriptorSets(cmdBuf_, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline.layout, 0, 1, &set, 0, nullptr);
+        if(_pipeline.pushConstantSize != 0 && _pushConstants != nullptr)
+            vkCmdPushConstants(cmdBuf_, _pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, _pipeline.pushConstantSize, _pushConstants);
+
+        vkCmdDispatch(cmdBuf_, _groupCntX, _groupCntY, _groupCntZ);
+        ++stats_.dispatches;
+    }
+
+    // ends recording and submits, returns the value the timeline reaches once the submit completes.
+    // _hostReadable: make the dispatches' writes visible to the host, see readBack()
+    uint64_t submit(bool _hostReadable = false) {
+        if(!recording_)
+            return submitCnt_;
+
+        if(_hostReadable) {
+            VkMemoryBarrier barrier = {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_HOST_READ_BIT
+            };
+            vkCmdPipelineBarrier(cmdBuf_, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+                0, 1, &barrier, 0, nullptr, 0, nullptr);
+        }
+
+        if(vkEndCommandBuffer(cmdBuf_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to end compute command buffer");
+        recording_ = false;
+
+        uint64_t value = submitCnt_ + 1;
+        VkTimelineSemaphoreSubmitInfo timelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &value
+        };
+
+        VkSubmitInfo submitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timelineInfo,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &cmdBuf_,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &timeline_
+        };
+
+        if(vkQueueSubmit(queue_, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+            throw std::runtime_error("Failed to submit compute command buffer");
+
+        submitCnt_ = value;
+        ++stats_.submits;
+        return value;
+    }
+
+    void wait(uint64_t _value) {
+        VkSemaphoreWaitInfo waitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .semaphoreCount = 1,
+            .pSemaphores = &timeline_,
+            .pValues = &_value
+        };
+
+        if(vkWaitSemaphores(device_, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+            throw std::runtime_error("Failed to wait for compute submit");
+    }
+
+    // runs what was recorded and copies _size bytes at _offset of _buffer into _dst once it's done
+    void readBack(const Buffer & _buffer, void * _dst, VkDeviceSize _size = VK_WHOLE_SIZE, VkDeviceSize _offset = 0) {
+        if(_size == VK_WHOLE_SIZE)
+            _size = _buffer.size - _offset;
+
+        if(recording_)
+            wait(submit(true));
+
+        allocator_->invalidate(_buffer.memory, _offset, _size);
+        std::memcpy(_dst, static_cast<const char *>(_buffer.memory.mapped) + _offset, _size);
+    }
+
+    template<typename T>
+    std::vector<T> readBack(const Buffer & _buffer) {
+        std::vector<T> values(_buffer.size / sizeof(T));
+        readBack(_buffer, values.data(), values.size() * sizeof(T));
+        return values;
+    }
+
+    static constexpr uint32_t groupCnt(uint32_t _itemCnt, uint32_t _groupSize) noexcept {
+        return (_itemCnt + _groupSize - 1) / _groupSize;
+    }
+
+    VkQueue queue() const noexcept {
+        return queue_;
+    }
+
+    uint32_t queueFamily() const noexcept {
+        return queueFamily_;
+    }
+
+    const Stats & stats() const noexcept {
+        return stats_;
+    }
+
+    void logStats(std::ostream & _out) const {
+        _out << "Compute: " << stats_.submits << " submits, " << stats_.dispatches << " dispatches, "
+            << stats_.barriers << " barriers\n";
+    }
+
+private:
+    static constexpr uint32_t SETS_PER_POOL = 64;
+    static constexpr uint32_t BUFFERS_PER_POOL = 8 * SETS_PER_POOL;
+
+    VkDevice device_ = VK_NULL_HANDLE;
+    MemoryAllocator * allocator_ = nullptr;
+    uint32_t queueFamily_ = 0;
+    VkQueue queue_ = VK_NULL_HANDLE;
+    VkPipelineCache cache_ = VK_NULL_HANDLE;
+
+    VkCommandPool commandPool_ = VK_NULL_HANDLE;
+    VkCommandBuffer cmdBuf_ = VK_NULL_HANDLE;
+    bool recording_ = false;
+
+    VkSemaphore timeline_ = VK_NULL_HANDLE;
+    uint64_t submitCnt_ = 0;
+
+    // sets only live until the next begin(), pools get added as a submit needs more
+    std::vector<VkDescriptorPool> descriptorPools_;
+    uint32_t poolsUsed_ = 0;
+
+    // accessed by dispatches since the last barrier
+    std::vector<VkBuffer> written_, read_;
+
+    Stats stats_;
+
+    static bool contains(const std::vector<VkBuffer> & _buffers, VkBuffer _buffer) noexcept {
+        return std::find(_buffers.begin(), _buffers.end(), _buffer) != _buffers.end();
+    }
+
+    VkDescriptorSet allocateSet(VkDescriptorSetLayout _layout) {
+        VkDescriptorSetAllocateInfo allocInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &_layout
+        };
+
+        VkDescriptorSet set;
+        if(poolsUsed_ != 0) {
+            allocInfo.descriptorPool = descriptorPools_[poolsUsed_ - 1];
+            if(vkAllocateDescriptorSets(device_, &allocInfo, &set) == VK_SUCCESS)
+                return set;
+        }
+
+        // the current pool is full
+        if(poolsUsed_ == descriptorPools_.size()) {
+            VkDescriptorPoolSize poolSize = {
+                .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = BUFFERS_PER_POOL
+            };
+
+            VkDescriptorPoolCreateInfo poolInfo = {
+                .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                .maxSets = SETS_PER_POOL,
+                .poolSizeCount = 1,
+                .pPoolSizes = &poolSize
+            };
+
+            VkDescriptorPool pool;
+            if(vkCreateDescriptorPool(device_, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create compute descriptor pool");
+            descriptorPools_.push_back(pool);
+        }
+
+        allocInfo.descriptorPool = descriptorPools_[poolsUsed_++];
+        if(vkAllocateDescriptorSets(device_, &allocInfo, &set) != VK_SUCCESS)
+            throw std::runtime_error("Failed to allocate compute descriptor set");
+
+        return set;
+    }
+};
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+
+#include <vulkan/vulkan.h>
+
+// Backend of the debug messenger. The callback copies a message into a preallocated ring of fixed-size slots,
+// without locks or allocation, whatever driver thread it runs on; a writer thread prints them.
+// Repeats of a message ID are only counted, a full ring drops the message and counts that too.
+class DebugLog {
+public:
+    static constexpr uint32_t SLOT_CNT = 1024; // power of two
+    static constexpr size_t MESSAGE_SIZE = 1024; // longer messages get truncated
+
+    DebugLog() : slots_(std::make_unique<Slot[]>(SLOT_CNT)) {
+        for(uint32_t i = 0; i< SLOT_CNT; ++i)
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    ~DebugLog() {
+        stop();
+    }
+
+    DebugLog(const DebugLog &) = delete;
+    DebugLog & operator=(const DebugLog &) = delete;
+
+    void start(VkDebugUtilsMessageSeverityFlagsEXT _severities, VkDebugUtilsMessageTypeFlagsEXT _types) {
+        setFilter(_severities, _types);
+        quit_.store(false, std::memory_order_relaxed);
+        writer_ = std::thread([this] { writerLoop(); });
+    }
+
+    // prints what is left in the ring and the repeat/drop summary
+    void stop() {
+        if(!writer_.joinable())
+            return;
+
+        quit_.store(true, std::memory_order_release);
+        writer_.join();
+    }
+
+    // may be changed at any time, messages outside of it are dropped in the callback without counting
+    void setFilter(VkDebugUtilsMessageSeverityFlagsEXT _severities, VkDebugUtilsMessageTypeFlagsEXT _types) noexcept {
+        severities_.store(_severities, std::memory_order_relaxed);
+        types_.store(_types, std::memory_order_relaxed);
+    }
+
+    uint64_t dropped() const noexcept {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+    // _userData: the DebugLog
+    static VKAPI_ATTR VkBool32 VKAPI_CALL callback(VkDebugUtilsMessageSeverityFlagBitsEXT _severity,
+        VkDebugUtilsMessageTypeFlagsEXT _type,
+        const VkDebugUtilsMessengerCallbackDataEXT * _data,
+        void * _userData) {
+        static_cast<DebugLog *>(_userData)->push(_severity, _type, _data->messageIdNumber, _data->pMessage);
+
+        return VK_FALSE;
+    }
+
+    void push(VkDebugUtilsMessageSeverityFlagBitsEXT _severity, VkDebugUtilsMessageTypeFlagsEXT _type,
+        int32_t _messageId, const char * _message) noexcept {
+        if(!(_severity & severities_.load(std::memory_order_relaxed)) || !(_type & types_.load(std::memory_order_relaxed)))
+            return;
+
+        // bounded MPSC queue: a slot is free for position pos when its sequence equals pos
+        uint64_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        Slot * slot;
+        while(true) {
+            slot = &slots_[pos & (SLOT_CNT - 1)];
+            uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+
+            if(sequence == pos) {
+                if(enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if(sequence < pos) {
+                // the writer hasn't caught up
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+        }
+
+        slot->severity = _severity;
+        slot->type = _type;
+        slot->messageId = _messageId;
+        // copies only the message, strncpy would zero-fill the rest of the slot
+        const char * message = _message != nullptr ? _message : "";
+        size_t length = strnlen(message, MESSAGE_SIZE - 1);
+        std::memcpy(slot->message, message, length);
+        slot->message[length] = '\0';
+
+        slot->sequence.store(pos + 1, std::memory_order_release);
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> sequence;
+        VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+        VkDebugUtilsMessageTypeFlagsEXT type;
+        int32_t messageId;
+        char message[MESSAGE_SIZE];
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    alignas(64) std::atomic<uint64_t> enqueuePos_ = 0;
+    alignas(64) std::atomic<uint64_t> dropped_ = 0;
+    std::atomic<VkDebugUtilsMessageSeverityFlagsEXT> severities_ = 0;
+    std::atomic<VkDebugUtilsMessageTypeFlagsEXT> types_ = 0;
+
+    std::thread writer_;
+    std::atomic<bool> quit_ = false;
+
+    // writer thread only
+    uint64_t dequeuePos_ = 0;
+    std::unordered_map<int32_t, uint64_t> repeats_; // message ID -> times seen
+
+    void writerLoop() {
+        while(true) {
+            // read before draining, so nothing pushed before stop() is left behind
+            bool quit = quit_.load(std::memory_order_acquire);
+
+            bool wrote = false;
+            while(pop())
+                wrote = true;
+
+            if(wrote)
+                std::fflush(stderr);
+
+            if(quit)
+                break;
+
+            // idle polling keeps the callback free of any wake-up
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+
+        printSummary();
+    }
+
+    bool pop() {
+        Slot & slot = slots_[dequeuePos_ & (SLOT_CNT - 1)];
+        if(slot.sequence.load(std::memory_order_acquire) != dequeuePos_ + 1)
+            return false;
+
+        // ID 0 is shared by all sorts of loader/general messages, those are always printed
+        bool repeated = false;
+        if(slot.messageId != 0)
+            repeated = repeats_[slot.messageId]++ > 0;
+
+        if(!repeated)
+            std::fprintf(stderr, "Validation layer(%s): %s\n", severityName(slot.severity), slot.message);
+
+        slot.sequence.store(dequeuePos_ + SLOT_CNT, std::memory_order_release);
+        ++dequeuePos_;
+        return true;
+    }
+
+    void printSummary() {
+        for(const auto & [messageId, cnt] : repeats_) {
+            if(cnt > 1)
+                std::fprintf(stderr, "Validation message 0x%08x repeated %llu times\n", uint32_t(messageId), (unsigned long long)(cnt - 1));
+        }
+
+        if(auto dropped = dropped_.load(std::memory_order_relaxed); dropped != 0)
+            std::fprintf(stderr, "Dropped %llu validation messages, the log ring was full\n", (unsigned long long)dropped);
+
+        std::fflush(stderr);
+    }
+
+    static const char * severityName(VkDebugUtilsMessageSeverityFlagBitsEXT _severity) noexcept {
+        switch(_severity) {
+        case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT: return "verbose";
+        case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT: return "info";
+        case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT: return "warning";
+        case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT: return "error";
+        default: return "?";
+        }
+    }
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+
+#include <vulkan/vulkan.h>
+
+// Objects the GPU may still be using, destroyed once a timeline semaphore reaches the value of the last submit
+// that used them instead of after a vkDeviceWaitIdle(). Holds anything that cleans up in its destructor
+// (VkHandle, Allocated, structs of them).
+class DeletionQueue {
+public:
+    // _timeline: signaled in submission order, e.g. with the frame number by every graphics submit
+    void init(VkDevice _device, VkSemaphore _timeline) noexcept {
+        device_ = _device;
+        timeline_ = _timeline;
+    }
+
+    // _lastValue: of the last submit using it
+    template<typename T>
+    void retire(uint64_t _lastValue, T && _object) {
+        // usually the newest, so the search runs from the back
+        auto pos = std::find_if(entries_.rbegin(), entries_.rend(),
+            [&](const Entry & _entry) { return _entry.value <= _lastValue; }).base();
+        entries_.insert(pos, { _lastValue, std::make_unique<Holder<std::decay_t<T>>>(std::forward<T>(_object)) });
+        ++retiredCnt_;
+    }
+
+    // destroys what the GPU is done with, returns how many
+    size_t collect() {
+        if(entries_.empty())
+            return 0;
+
+        // after a device loss the value means nothing, better to leak than to free what may still be in use
+        uint64_t completed;
+        if(vkGetSemaphoreCounterValue(device_, timeline_, &completed) != VK_SUCCESS)
+            return 0;
+
+        size_t cnt = 0;
+        while(!entries_.empty() && entries_.front().value <= completed) {
+            entries_.pop_front();
+            ++cnt;
+        }
+
+        return cnt;
+    }
+
+    // the device must be idle
+    void flush() noexcept {
+        entries_.clear();
+    }
+
+    void logStats(std::ostream & _out) const {
+        _out << "Deletion queue: " << retiredCnt_ << " objects retired, " << entries_.size() << " pending\n";
+    }
+
+private:
+    struct HolderBase {
+        virtual ~HolderBase() = default;
+    };
+
+    template<typename T>
+    struct Holder : HolderBase {
+        T object;
+
+        explicit Holder(T && _object) : object(std::move(_object)) {}
+        explicit Holder(const T & _object) : object(_object) {}
+    };
+
+    struct Entry {
+        uint64_t value;
+        std::unique_ptr<HolderBase> object;
+    };
+
+    VkDevice device_ = VK_NULL_HANDLE;
+    VkSemaphore timeline_ = VK_NULL_HANDLE;
+    std::deque<Entry> entries_; // by value, equal ones in retire() order
+    uint64_t retiredCnt_ = 0;
+};
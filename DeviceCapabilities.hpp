@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+struct QueueFamilyIndices {
+    std::optional<uint32_t> graphicsFamily; // gpu family
+    std::optional<uint32_t> presentFamily;
+    // transfer-only, optional: uploads fall back to the graphics queue
+    std::optional<uint32_t> transferFamily;
+    // a family without graphics when there is one, so compute jobs can overlap rendering
+    std::optional<uint32_t> computeFamily;
+
+    bool isComplete() const noexcept {
+        return graphicsFamily.has_value() && presentFamily.has_value() && computeFamily.has_value();
+    }
+};
+
+// What init needs to know about a physical device, queried once during device selection and read-only afterwards.
+// Surface capabilities are left out, they change with the window size.
+struct DeviceCapabilities {
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+
+    VkPhysicalDeviceProperties properties {};
+    VkPhysicalDeviceVulkan12Properties properties12 {}; // pNext cleared
+    VkPhysicalDeviceFeatures features {};
+    VkPhysicalDeviceVulkan12Features features12 {}; // pNext cleared
+    VkPhysicalDeviceMemoryProperties memoryProperties {};
+
+    std::vector<VkQueueFamilyProperties> queueFamilies;
+    std::vector<VkBool32> presentSupport; // per queue family, all VK_FALSE without a surface
+    std::set<std::string> extensions;
+
+    std::vector<VkSurfaceFormatKHR> surfaceFormats;
+    std::vector<VkPresentModeKHR> presentModes;
+
+    QueueFamilyIndices queueFamilyIndices;
+    VkDeviceSize deviceLocalBytes = 0;
+    bool dedicatedCompute = false; // a compute family without graphics
+
+    // _surface VK_NULL_HANDLE: headless, the graphics family stands in for presentation
+    static DeviceCapabilities query(VkPhysicalDevice _device, VkSurfaceKHR _surface) {
+        DeviceCapabilities caps;
+        caps.physicalDevice = _device;
+
+        caps.properties12 = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES
+        };
+        VkPhysicalDeviceProperties2 properties2 = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &caps.properties12
+        };
+        vkGetPhysicalDeviceProperties2(_device, &properties2);
+        caps.properties = properties2.properties;
+        caps.properties12.pNext = nullptr;
+
+        vkGetPhysicalDeviceMemoryProperties(_device, &caps.memoryProperties);
+
+        caps.features12 = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES
+        };
+        VkPhysicalDeviceFeatures2 features2 = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+            .pNext = &caps.features12
+        };
+        vkGetPhysicalDeviceFeatures2(_device, &features2);
+        caps.features = features2.features;
+        caps.features12.pNext = nullptr;
+
+        uint32_t queueFamilyCnt = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(_device, &queueFamilyCnt, nullptr);
+        caps.queueFamilies.resize(queueFamilyCnt);
+        vkGetPhysicalDeviceQueueFamilyProperties(_device, &queueFamilyCnt, caps.queueFamilies.data());
+
+        caps.presentSupport.assign(queueFamilyCnt, VK_FALSE);
+        if(_surface != VK_NULL_HANDLE) {
+            for(uint32_t i = 0; i< queueFamilyCnt; ++i)
+                vkGetPhysicalDeviceSurfaceSupportKHR(_device, i, _surface, &caps.presentSupport[i]);
+        }
+
+        uint32_t extensionCnt = 0;
+        vkEnumerateDeviceExtensionProperties(_device, nullptr, &extensionCnt, nullptr);
+        std::vector<VkExtensionProperties> extensions(extensionCnt);
+        vkEnumerateDeviceExtensionProperties(_device, nullptr, &extensionCnt, extensions.data());
+        for(const auto & ext : extensions)
+            caps.extensions.insert(ext.extensionName);
+
+        if(_surface != VK_NULL_HANDLE) {
+            uint32_t formatCnt = 0;
+            vkGetPhysicalDeviceSurfaceFormatsKHR(_device, _surface, &formatCnt, nullptr);
+            caps.surfaceFormats.resize(formatCnt);
+            vkGetPhysicalDeviceSurfaceFormatsKHR(_device, _surface, &formatCnt, caps.surfaceFormats.data());
+
+            uint32_t presentModeCnt = 0;
+            vkGetPhysicalDeviceSurfacePresentModesKHR(_device, _surface, &presentModeCnt, nullptr);
+            caps.presentModes.resize(presentModeCnt);
+            vkGetPhysicalDeviceSurfacePresentModesKHR(_device, _surface, &presentModeCnt, caps.presentModes.data());
+        }
+
+        for(uint32_t i = 0; i< caps.memoryProperties.memoryHeapCount; ++i) {
+            const auto & heap = caps.memoryProperties.memoryHeaps[i];
+            if(heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+                caps.deviceLocalBytes += heap.size;
+        }
+
+        caps.findQueueFamilies(_surface == VK_NULL_HANDLE);
+
+        return caps;
+    }
+
+    bool supportsExtensions(const std::vector<const char *> & _names) const {
+        return std::all_of(_names.begin(), _names.end(), [this](const char * _name) { return extensions.count(_name) != 0; });
+    }
+
+    // discrete over integrated over virtual over CPU, then device-local memory, then dedicated queues.
+    // unusable devices are filtered out before, see VkProgram::isDeviceSuitable()
+    uint64_t score() const noexcept {
+        uint64_t typeRank = 0;
+        switch(properties.deviceType) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: typeRank = 4; break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: typeRank = 3; break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: typeRank = 2; break;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU: typeRank = 1; break;
+        default: break;
+        }
+
+        uint64_t deviceLocalMiB = std::min<uint64_t>(deviceLocalBytes >> 20, (1ULL << 30) - 1);
+
+        return typeRank << 40 | deviceLocalMiB << 2
+            | uint64_t(dedicatedCompute) << 1 | uint64_t(queueFamilyIndices.transferFamily.has_value());
+    }
+
+private:
+    void findQueueFamilies(bool _headless) noexcept {
+        auto & indices = queueFamilyIndices;
+
+        for(uint32_t i = 0; i< queueFamilies.size(); ++i) {
+            auto flags = queueFamilies[i].queueFlags;
+
+            if((flags & VK_QUEUE_GRAPHICS_BIT) && !indices.graphicsFamily)
+                indices.graphicsFamily = i;
+
+            // a family without graphics and compute is usually backed by a separate DMA engine
+            if((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) && !indices.transferFamily)
+                indices.transferFamily = i;
+
+            if((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) && !dedicatedCompute) {
+                indices.computeFamily = i;
+                dedicatedCompute = true;
+            }
+        }
+
+        // every device with graphics has a family with graphics and compute, prefer that one over any other
+        for(uint32_t i = 0; i< queueFamilies.size() && !indices.computeFamily; ++i) {
+            if((queueFamilies[i].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))
+                indices.computeFamily = i;
+        }
+
+        // nothing is presented headless, the graphics queue stands in
+        if(_headless) {
+            indices.presentFamily = indices.graphicsFamily;
+            return;
+        }
+
+        // presenting from the graphics family saves a queue ownership transfer of the swapchain images
+        if(indices.graphicsFamily && presentSupport[*indices.graphicsFamily]) {
+            indices.presentFamily = indices.graphicsFamily;
+            return;
+        }
+
+        for(uint32_t i = 0; i< queueFamilies.size(); ++i) {
+            if(presentSupport[i]) {
+                indices.presentFamily = i;
+                break;
+            }
+        }
+    }
+};
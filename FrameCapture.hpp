@@ -0,0 +1,298 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "MemoryAllocator.hpp"
+
+// Streams rendered frames to disk without stalling the render thread.
+// Each captured frame is copied into one of a ring of host-visible readback buffers by the frame's own command buffer;
+// a writer thread waits for the frame on the graphics timeline, converts it and appends it to the output file.
+// The file is a stream of binary PPMs, one per frame (ffmpeg -f image2pipe -c:v ppm -i <file> reads it).
+class FrameCapture {
+public:
+    struct Stats {
+        uint64_t written = 0;
+        uint64_t dropped = 0; // the ring was full
+        uint64_t bytes = 0;
+        double writeMs = 0.0; // writer thread time spent converting and writing
+    };
+
+    // _blockWhenFull: a full ring waits for the writer instead of dropping the frame, for runs that need every frame
+    void init(VkDevice _device, MemoryAllocator & _allocator, VkSemaphore _timeline, const std::string & _path,
+        uint32_t _slotCnt, bool _blockWhenFull) {
+        device_ = _device;
+        allocator_ = &_allocator;
+        timeline_ = _timeline;
+        blockWhenFull_ = _blockWhenFull;
+
+        file_.open(_path, std::ios::binary | std::ios::trunc);
+        if(!file_.is_open())
+            throw std::runtime_error("Failed to open capture file(\"" + _path + "\")");
+
+        slots_.resize(std::max(_slotCnt, 1U));
+        quit_ = false;
+        writer_ = std::thread([this] { writerLoop(); });
+    }
+
+    // writes what was submitted, then frees the ring
+    void destroy() noexcept {
+        if(writer_.joinable()) {
+            {
+                std::lock_guard lock(mutex_);
+                quit_ = true;
+            }
+            queueCv_.notify_all();
+            writer_.join();
+        }
+
+        for(auto & slot : slots_) {
+            if(slot.buffer != VK_NULL_HANDLE)
+                allocator_->destroyBuffer(slot.buffer, slot.memory);
+        }
+        slots_.clear();
+
+        file_.close();
+    }
+
+    // records the copy of _image into the next free slot, call outside of a render pass once the image is rendered.
+    // _layout: the image's current layout, it is left in it. false: the ring was full, nothing recorded
+    bool cmdCapture(VkCommandBuffer _cmdBuf, VkImage _image, VkImageLayout _layout, VkFormat _format, VkExtent2D _extent) {
+        Slot & slot = slots_[nextSlot_];
+        {
+            std::unique_lock lock(mutex_);
+            if(slot.busy && !blockWhenFull_) {
+                ++stats_.dropped;
+                return false;
+            }
+
+            freeCv_.wait(lock, [&] { return !slot.busy; });
+        }
+
+        // free, so the writer is done with it and so is the GPU
+        VkDeviceSize size = VkDeviceSize(_extent.width) * _extent.height * 4;
+        if(size > slot.capacity) {
+            if(slot.buffer != VK_NULL_HANDLE)
+                allocator_->destroyBuffer(slot.buffer, slot.memory);
+
+            // cached memory makes the writer's reads a lot faster where available
+            std::tie(slot.buffer, slot.memory) = allocator_->createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+            slot.capacity = size;
+        }
+
+        slot.format = _format;
+        slot.extent = _extent;
+
+        bool transition = _layout != VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+        // otherwise the render pass' external dependency already made the writes visible to transfers
+        if(transition) {
+            VkImageMemoryBarrier toTransfer = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+                .oldLayout = _layout,
+                .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = _image,
+                .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+            };
+            vkCmdPipelineBarrier(_cmdBuf, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                0, 0, nullptr, 0, nullptr, 1, &toTransfer);
+        }
+
+        VkBufferImageCopy region = {
+            .bufferOffset = 0,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+            .imageOffset = { 0, 0, 0 },
+            .imageExtent = { _extent.width, _extent.height, 1 }
+        };
+        vkCmdCopyImageToBuffer(_cmdBuf, _image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1, &region);
+
+        if(transition) {
+            // presentation waits on a semaphore, which covers the memory side
+            VkImageMemoryBarrier toPrevious = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                .srcAccessMask = 0,
+                .dstAccessMask = 0,
+                .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                .newLayout = _layout,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = _image,
+                .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+            };
+            vkCmdPipelineBarrier(_cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                0, 0, nullptr, 0, nullptr, 1, &toPrevious);
+        }
+
+        VkBufferMemoryBarrier toHost = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = slot.buffer,
+            .offset = 0,
+            .size = size
+        };
+        vkCmdPipelineBarrier(_cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+            0, 0, nullptr, 1, &toHost, 0, nullptr);
+
+        recordedSlot_ = nextSlot_;
+        nextSlot_ = (nextSlot_ + 1) % slots_.size();
+        return true;
+    }
+
+    // the command buffer of the last cmdCapture() was submitted, signaling _frameValue on the timeline
+    void submitted(uint64_t _frameValue) {
+        if(!recordedSlot_)
+            return;
+
+        {
+            std::lock_guard lock(mutex_);
+            Slot & slot = slots_[*recordedSlot_];
+            slot.busy = true;
+            slot.frameValue = _frameValue;
+            queue_.push_back(*recordedSlot_);
+        }
+        queueCv_.notify_one();
+
+        recordedSlot_.reset();
+    }
+
+    Stats stats() {
+        std::lock_guard lock(mutex_);
+        return stats_;
+    }
+
+    void logStats(std::ostream & _out) {
+        auto stats = this->stats();
+        double mib = stats.bytes / (1024.0 * 1024.0);
+
+        _out << "Capture: " << stats.written << " frames, " << mib << " MiB, " << stats.dropped << " dropped";
+        if(stats.written != 0)
+            _out << ", writer " << stats.writeMs / stats.written << " ms/frame (" << mib / (stats.writeMs / 1000.0) << " MiB/s)";
+        _out << "\n";
+    }
+
+private:
+    struct Slot {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        MemoryAllocator::Allocation memory;
+        VkDeviceSize capacity = 0;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkExtent2D extent = {};
+        uint64_t frameValue = 0;
+        bool busy = false; // submitted, not yet written
+    };
+
+    VkDevice device_ = VK_NULL_HANDLE;
+    MemoryAllocator * allocator_ = nullptr;
+    VkSemaphore timeline_ = VK_NULL_HANDLE;
+    bool blockWhenFull_ = false;
+
+    // slots are used in ring order, the writer takes them in the same order
+    std::vector<Slot> slots_;
+    size_t nextSlot_ = 0;
+    std::optional<size_t> recordedSlot_;
+
+    std::thread writer_;
+    std::mutex mutex_;
+    std::condition_variable queueCv_, freeCv_;
+    std::deque<size_t> queue_;
+    bool quit_ = false;
+    Stats stats_;
+
+    // writer thread only
+    std::ofstream file_;
+    std::vector<char> frame_;
+
+    void writerLoop() {
+        while(true) {
+            size_t index;
+            {
+                std::unique_lock lock(mutex_);
+                queueCv_.wait(lock, [this] { return quit_ || !queue_.empty(); });
+
+                // everything submitted still gets written
+                if(queue_.empty())
+                    return;
+
+                index = queue_.front();
+                queue_.pop_front();
+            }
+
+            // only the render thread resizes a slot and only while it's free, the fields are stable
+            Slot & slot = slots_[index];
+
+            VkSemaphoreWaitInfo waitInfo = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+                .semaphoreCount = 1,
+                .pSemaphores = &timeline_,
+                .pValues = &slot.frameValue
+            };
+            bool ready = vkWaitSemaphores(device_, &waitInfo, UINT64_MAX) == VK_SUCCESS;
+
+            auto start = std::chrono::steady_clock::now();
+
+            uint64_t bytes = ready ? writeFrame(slot) : 0;
+
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            {
+                std::lock_guard lock(mutex_);
+                slot.busy = false;
+                if(ready) {
+                    ++stats_.written;
+                    stats_.bytes += bytes;
+                    stats_.writeMs += elapsed.count();
+                } else
+                    ++stats_.dropped;
+            }
+            freeCv_.notify_one();
+        }
+    }
+
+    // one binary PPM, converted in memory and appended with a single write
+    uint64_t writeFrame(const Slot & _slot) {
+        allocator_->invalidate(_slot.memory);
+
+        std::string header = "P6\n" + std::to_string(_slot.extent.width) + ' ' + std::to_string(_slot.extent.height) + "\n255\n";
+        size_t pixelCnt = size_t(_slot.extent.width) * _slot.extent.height;
+
+        frame_.resize(header.size() + pixelCnt * 3);
+        std::copy(header.begin(), header.end(), frame_.begin());
+
+        // 8 bit RGBA or BGRA, the swapchain may use either
+        bool bgra = _slot.format == VK_FORMAT_B8G8R8A8_UNORM || _slot.format == VK_FORMAT_B8G8R8A8_SRGB;
+        size_t r = bgra ? 2 : 0, b = bgra ? 0 : 2;
+
+        auto src = static_cast<const uint8_t *>(_slot.memory.mapped);
+        auto dst = frame_.data() + header.size();
+        for(size_t i = 0; i< pixelCnt; ++i, src += 4, dst += 3) {
+            dst[0] = src[r];
+            dst[1] = src[1];
+            dst[2] = src[b];
+        }
+
+        file_.write(frame_.data(), frame_.size());
+        return frame_.size();
+    }
+};
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <stdexcept>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "DeviceCapabilities.hpp"
+
+// Per-slot GPU timestamps and pipeline statistics around the recorded frame work.
+// Results are collected without waiting, once the slot's previous submission is known to be done.
+class GpuProfiler {
+public:
+    struct FrameStats {
+        double minMs = 0.0, avgMs = 0.0, p99Ms = 0.0;
+        size_t sampleCnt = 0;
+
+        // of the most recently collected frame
+        uint64_t vertexInvocations = 0;
+        uint64_t fragmentInvocations = 0;
+    };
+
+    static constexpr size_t HISTORY_SIZE = 256;
+
+    static constexpr VkQueryPipelineStatisticFlags STATISTICS = VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT
+        | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+    void init(VkDevice _device, const DeviceCapabilities & _caps, uint32_t _queueFamily,
+        uint32_t _slotCnt, bool _pipelineStatistics) {
+        device_ = _device;
+        slotCnt_ = _slotCnt;
+
+        timestampPeriod_ = _caps.properties.limits.timestampPeriod;
+        timestampValidBits_ = _caps.queueFamilies[_queueFamily].timestampValidBits;
+
+        if(timestampValidBits_ != 0) {
+            VkQueryPoolCreateInfo poolInfo = {
+                .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                .queryType = VK_QUERY_TYPE_TIMESTAMP,
+                .queryCount = 2 * slotCnt_
+            };
+
+            if(vkCreateQueryPool(device_, &poolInfo, nullptr, &timestampPool_) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create timestamp query pool");
+        }
+
+        if(_pipelineStatistics) {
+            VkQueryPoolCreateInfo poolInfo = {
+                .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+                .queryCount = slotCnt_,
+                .pipelineStatistics = STATISTICS
+            };
+
+            if(vkCreateQueryPool(device_, &poolInfo, nullptr, &statisticsPool_) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create pipeline statistics query pool");
+        }
+
+        pending_.assign(slotCnt_, false);
+        lastLog_ = std::chrono::steady_clock::now();
+    }
+
+    void destroy() noexcept {
+        if(timestampPool_ != VK_NULL_HANDLE)
+            vkDestroyQueryPool(device_, timestampPool_, nullptr);
+        if(statisticsPool_ != VK_NULL_HANDLE)
+            vkDestroyQueryPool(device_, statisticsPool_, nullptr);
+
+        timestampPool_ = statisticsPool_ = VK_NULL_HANDLE;
+    }
+
+    // what secondaries executed within cmdBegin()/cmdEnd() must inherit, 0: no statistics query
+    VkQueryPipelineStatisticFlags statisticsFlags() const noexcept {
+        return statisticsPool_ != VK_NULL_HANDLE ? STATISTICS : 0;
+    }
+
+    // must be recorded outside of a render pass
+    void cmdBegin(VkCommandBuffer _cmdBuf, uint32_t _slot) noexcept {
+        if(_slot >= slotCnt_)
+            return;
+
+        if(timestampPool_ != VK_NULL_HANDLE) {
+            vkCmdResetQueryPool(_cmdBuf, timestampPool_, 2 * _slot, 2);
+            vkCmdWriteTimestamp(_cmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool_, 2 * _slot);
+        }
+
+        if(statisticsPool_ != VK_NULL_HANDLE) {
+            vkCmdResetQueryPool(_cmdBuf, statisticsPool_, _slot, 1);
+            vkCmdBeginQuery(_cmdBuf, statisticsPool_, _slot, 0);
+        }
+    }
+
+    void cmdEnd(VkCommandBuffer _cmdBuf, uint32_t _slot) noexcept {
+        if(_slot >= slotCnt_)
+            return;
+
+        if(statisticsPool_ != VK_NULL_HANDLE)
+            vkCmdEndQuery(_cmdBuf, statisticsPool_, _slot);
+
+        if(timestampPool_ != VK_NULL_HANDLE)
+            vkCmdWriteTimestamp(_cmdBuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool_, 2 * _slot + 1);
+    }
+
+    // the slot's queries were submitted
+    void submitted(uint32_t _slot) noexcept {
+        if(_slot < slotCnt_)
+            pending_[_slot] = true;
+    }
+
+    // non-blocking, leaves the slot pending if the results are not there yet
+    void collect(uint32_t _slot) noexcept {
+        if(_slot >= slotCnt_ || !pending_[_slot])
+            return;
+
+        if(timestampPool_ != VK_NULL_HANDLE) {
+            // { value, availability } per query
+            std::array<uint64_t, 4> results {};
+            auto res = vkGetQueryPoolResults(device_, timestampPool_, 2 * _slot, 2,
+                sizeof(results), results.data(), 2 * sizeof(uint64_t),
+                VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+            if(res != VK_SUCCESS || results[1] == 0 || results[3] == 0)
+                return;
+
+            uint64_t mask = timestampValidBits_ >= 64 ? ~0ULL : (1ULL << timestampValidBits_) - 1;
+            uint64_t ticks = (results[2] - results[0]) & mask;
+
+            history_[historyHead_] = ticks * double(timestampPeriod_) * 1e-6;
+            historyHead_ = (historyHead_ + 1) % HISTORY_SIZE;
+            historyCnt_ = std::min(historyCnt_ + 1, HISTORY_SIZE);
+        }
+
+        if(statisticsPool_ != VK_NULL_HANDLE) {
+            // results come in bit order: vertex, fragment, availability
+            std::array<uint64_t, 3> results {};
+            auto res = vkGetQueryPoolResults(device_, statisticsPool_, _slot, 1,
+                sizeof(results), results.data(), sizeof(results),
+                VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+            if(res == VK_SUCCESS && results[2] != 0) {
+                lastStats_.vertexInvocations = results[0];
+                lastStats_.fragmentInvocations = results[1];
+            }
+        }
+
+        pending_[_slot] = false;
+    }
+
+    FrameStats stats() const {
+        FrameStats stats = lastStats_;
+        stats.sampleCnt = historyCnt_;
+
+        if(historyCnt_ == 0)
+            return stats;
+
+        std::vector<double> samples(history_.begin(), history_.begin() + historyCnt_);
+
+        stats.minMs = *std::min_element(samples.begin(), samples.end());
+
+        double sum = 0.0;
+        for(auto sample : samples)
+            sum += sample;
+        stats.avgMs = sum / samples.size();
+
+        auto p99 = samples.begin() + (samples.size() - 1) * 99 / 100;
+        std::nth_element(samples.begin(), p99, samples.end());
+        stats.p99Ms = *p99;
+
+        return stats;
+    }
+
+    // drops the frame time history, e.g. between benchmark runs
+    void reset() noexcept {
+        historyHead_ = historyCnt_ = 0;
+    }
+
+    // true at most once per _interval
+    bool shouldLog(std::chrono::milliseconds _interval = std::chrono::seconds(2)) noexcept {
+        auto now = std::chrono::steady_clock::now();
+        if(now - lastLog_ < _interval)
+            return false;
+
+        lastLog_ = now;
+        return true;
+    }
+
+    bool enabled() const noexcept {
+        return timestampPool_ != VK_NULL_HANDLE || statisticsPool_ != VK_NULL_HANDLE;
+    }
+
+private:
+    VkDevice device_ = VK_NULL_HANDLE;
+    VkQueryPool timestampPool_ = VK_NULL_HANDLE;
+    VkQueryPool statisticsPool_ = VK_NULL_HANDLE;
+
+    uint32_t slotCnt_ = 0;
+    uint32_t timestampValidBits_ = 0;
+    float timestampPeriod_ = 1.0F;
+
+    std::vector<bool> pending_;
+
+    std::array<double, HISTORY_SIZE> history_ {};
+    size_t historyHead_ = 0, historyCnt_ = 0;
+
+    FrameStats lastStats_;
+    std::chrono::steady_clock::time_point lastLog_;
+};
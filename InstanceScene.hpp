@@ -0,0 +1,311 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <random>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define INSTANCE_SCENE_X86
+#include <immintrin.h>
+#endif
+
+#include "JobSystem.hpp"
+
+// an instance as the vertex shader reads it (std430)
+struct InstanceGpu {
+    float transform[4]; // offset x/y, scale, rotation
+    float color[4];
+};
+
+// Per-instance state as structure of arrays, animated on the CPU and packed into InstanceGpu every frame.
+// The arrays are 32 byte aligned and padded to whole batches of 8, the update runs AVX2, SSE or scalar kernels
+// (picked at runtime) over chunks of instances in parallel, culls their bounding circles against the view on the way
+// and packs the visible ones straight into the frame's mapped instance buffer.
+class InstanceScene {
+public:
+    static constexpr uint32_t BATCH = 8; // lanes of an AVX register, SSE does two halves
+    // instances per job, enough to keep the job overhead out of the profile
+    static constexpr uint32_t CHUNK = 16384;
+
+    InstanceScene() : kernel_(pickKernel()) {}
+
+    // a single instance is the identity, more get scattered over the viewport and start moving
+    void resize(uint32_t _cnt, uint32_t _seed = 1) {
+        cnt_ = _cnt;
+
+        // padding lanes get updated and culled like any other, the masks drop them
+        size_t padded = (size_t(_cnt) + BATCH - 1) / BATCH * BATCH;
+        posX_.assign(padded, 0.0F);
+        posY_.assign(padded, 0.0F);
+        velX_.assign(padded, 0.0F);
+        velY_.assign(padded, 0.0F);
+        scale_.assign(padded, 1.0F);
+        rotation_.assign(padded, 0.0F);
+        spin_.assign(padded, 0.0F);
+        colorR_.assign(padded, 1.0F);
+        colorG_.assign(padded, 1.0F);
+        colorB_.assign(padded, 1.0F);
+
+        masks_.assign(padded / BATCH, 0);
+        chunkOffsets_.assign((_cnt + CHUNK - 1) / CHUNK + 1, 0);
+
+        if(_cnt <= 1)
+            return;
+
+        std::mt19937 rng(_seed);
+        std::uniform_real_distribution<float> unit(-1.0F, 1.0F), color(0.25F, 1.0F);
+
+        // roughly constant coverage whatever the count
+        float scale = std::min(1.0F, 1.5F / std::sqrt(float(_cnt)));
+
+        for(uint32_t i = 0; i< _cnt; ++i) {
+            posX_[i] = unit(rng);
+            posY_[i] = unit(rng);
+            velX_[i] = unit(rng) * 0.25F;
+            velY_[i] = unit(rng) * 0.25F;
+            scale_[i] = scale;
+            rotation_[i] = unit(rng) * 3.14159265F;
+            spin_[i] = unit(rng) * 2.0F;
+            colorR_[i] = color(rng);
+            colorG_[i] = color(rng);
+            colorB_[i] = color(rng);
+        }
+    }
+
+    uint32_t size() const noexcept {
+        return cnt_;
+    }
+
+    // "AVX2", "SSE" or "scalar"
+    const char * kernelName() const noexcept {
+        return kernel_.name;
+    }
+
+    // moves and spins every instance, bouncing off the viewport edges, then packs the ones whose bounding circle
+    // (_boundingRadius of the mesh times the instance scale) overlaps the view into _dst and returns how many.
+    // _dst must have room for size() instances, an infinite radius packs all of them (the GPU culls).
+    // Clip space x/y in [-1, 1] is the whole frustum of the 2D scene, like the cull shader assumes
+    uint32_t update(float _dt, float _boundingRadius, InstanceGpu * _dst, JobSystem & _jobs) {
+        if(cnt_ == 0)
+            return 0;
+
+        Soa soa = {
+            .posX = posX_.data(), .posY = posY_.data(),
+            .velX = velX_.data(), .velY = velY_.data(),
+            .scale = scale_.data(),
+            .rotation = rotation_.data(), .spin = spin_.data()
+        };
+
+        uint32_t chunkCnt = static_cast<uint32_t>(chunkOffsets_.size() - 1);
+
+        // animate and cull, each chunk counts its visible instances
+        _jobs.parallelFor(cnt_, CHUNK, [&](uint32_t _begin, uint32_t _end, uint32_t) {
+            chunkOffsets_[_begin / CHUNK + 1] = kernel_.update(soa, _begin, _end, _dt, _boundingRadius, masks_.data());
+        });
+
+        for(uint32_t i = 0; i< chunkCnt; ++i)
+            chunkOffsets_[i + 1] += chunkOffsets_[i];
+
+        // every chunk writes its own contiguous range, front to back suits write-combined memory
+        _jobs.parallelFor(cnt_, CHUNK, [&](uint32_t _begin, uint32_t _end, uint32_t) {
+            pack(_begin, _end, _dst + chunkOffsets_[_begin / CHUNK]);
+        });
+
+        return chunkOffsets_[chunkCnt];
+    }
+
+private:
+    // 32 byte aligned storage, loads never straddle cache lines
+    template<typename T>
+    struct SimdAllocator {
+        using value_type = T;
+        static constexpr std::align_val_t ALIGNMENT { 32 };
+
+        SimdAllocator() = default;
+        template<typename U>
+        SimdAllocator(const SimdAllocator<U> &) noexcept {}
+
+        T * allocate(size_t _n) {
+            return static_cast<T *>(::operator new(_n * sizeof(T), ALIGNMENT));
+        }
+
+        void deallocate(T * _p, size_t) noexcept {
+            ::operator delete(_p, ALIGNMENT);
+        }
+
+        bool operator==(const SimdAllocator &) const noexcept = default;
+    };
+    using FloatArray = std::vector<float, SimdAllocator<float>>;
+
+    // what the update kernels touch
+    struct Soa {
+        float * posX, * posY;
+        float * velX, * velY;
+        const float * scale;
+        float * rotation;
+        const float * spin;
+    };
+
+    // updates [_begin, _end), _begin a multiple of BATCH. Writes a visibility mask per batch, returns the visible count
+    using UpdateFn = uint32_t (*)(const Soa &, uint32_t, uint32_t, float, float, uint8_t *);
+
+    struct Kernel {
+        UpdateFn update;
+        const char * name;
+    };
+
+    uint32_t cnt_ = 0;
+    FloatArray posX_, posY_;
+    FloatArray velX_, velY_;
+    FloatArray scale_;
+    FloatArray rotation_, spin_;
+    FloatArray colorR_, colorG_, colorB_;
+
+    std::vector<uint8_t> masks_; // per batch, bit i: lane i visible
+    std::vector<uint32_t> chunkOffsets_; // into the packed instances, the last one is the visible count
+
+    Kernel kernel_;
+
+    static Kernel pickKernel() noexcept {
+#ifdef INSTANCE_SCENE_X86
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2"))
+            return { updateAvx2, "AVX2" };
+        if(__builtin_cpu_supports("sse2"))
+            return { updateSse, "SSE" };
+#endif
+        return { updateScalar, "scalar" };
+    }
+
+    // lanes of the batch at _first that are instances, not padding
+    static uint32_t laneMask(uint32_t _first, uint32_t _end) noexcept {
+        return _end - _first >= BATCH ? 0xFFU : (1U << (_end - _first)) - 1;
+    }
+
+    static uint32_t updateScalar(const Soa & _soa, uint32_t _begin, uint32_t _end, float _dt, float _radius, uint8_t * _masks) {
+        uint32_t visibleCnt = 0;
+
+        for(uint32_t first = _begin; first< _end; first += BATCH) {
+            uint32_t mask = 0;
+            for(uint32_t lane = 0; lane< BATCH; ++lane) {
+                uint32_t i = first + lane;
+                _soa.posX[i] += _soa.velX[i] * _dt;
+                _soa.posY[i] += _soa.velY[i] * _dt;
+                _soa.rotation[i] += _soa.spin[i] * _dt;
+
+                if(_soa.posX[i] < -1.0F || _soa.posX[i] > 1.0F)
+                    _soa.velX[i] = -_soa.velX[i];
+                if(_soa.posY[i] < -1.0F || _soa.posY[i] > 1.0F)
+                    _soa.velY[i] = -_soa.velY[i];
+
+                float radius = _radius * _soa.scale[i];
+                if(std::abs(_soa.posX[i]) - radius <= 1.0F && std::abs(_soa.posY[i]) - radius <= 1.0F)
+                    mask |= 1U << lane;
+            }
+
+            mask &= laneMask(first, _end);
+            _masks[first / BATCH] = static_cast<uint8_t>(mask);
+            visibleCnt += std::popcount(mask);
+        }
+
+        return visibleCnt;
+    }
+
+#ifdef INSTANCE_SCENE_X86
+    // the same steps as updateScalar(), 4 lanes at a time
+    __attribute__((target("sse2")))
+    static uint32_t updateSse(const Soa & _soa, uint32_t _begin, uint32_t _end, float _dt, float _radius, uint8_t * _masks) {
+        const __m128 dt = _mm_set1_ps(_dt), radius = _mm_set1_ps(_radius);
+        const __m128 one = _mm_set1_ps(1.0F), minusOne = _mm_set1_ps(-1.0F), sign = _mm_set1_ps(-0.0F);
+
+        uint32_t visibleCnt = 0;
+
+        for(uint32_t first = _begin; first< _end; first += BATCH) {
+            uint32_t mask = 0;
+            for(uint32_t half = 0; half< BATCH; half += 4) {
+                uint32_t i = first + half;
+
+                __m128 posX = _mm_add_ps(_mm_load_ps(_soa.posX + i), _mm_mul_ps(_mm_load_ps(_soa.velX + i), dt));
+                __m128 posY = _mm_add_ps(_mm_load_ps(_soa.posY + i), _mm_mul_ps(_mm_load_ps(_soa.velY + i), dt));
+                __m128 rotation = _mm_add_ps(_mm_load_ps(_soa.rotation + i), _mm_mul_ps(_mm_load_ps(_soa.spin + i), dt));
+
+                // flips the velocity's sign bit where the position left [-1, 1]
+                __m128 outX = _mm_or_ps(_mm_cmplt_ps(posX, minusOne), _mm_cmpgt_ps(posX, one));
+                __m128 outY = _mm_or_ps(_mm_cmplt_ps(posY, minusOne), _mm_cmpgt_ps(posY, one));
+                _mm_store_ps(_soa.velX + i, _mm_xor_ps(_mm_load_ps(_soa.velX + i), _mm_and_ps(outX, sign)));
+                _mm_store_ps(_soa.velY + i, _mm_xor_ps(_mm_load_ps(_soa.velY + i), _mm_and_ps(outY, sign)));
+
+                _mm_store_ps(_soa.posX + i, posX);
+                _mm_store_ps(_soa.posY + i, posY);
+                _mm_store_ps(_soa.rotation + i, rotation);
+
+                __m128 r = _mm_mul_ps(radius, _mm_load_ps(_soa.scale + i));
+                __m128 visible = _mm_and_ps(
+                    _mm_cmple_ps(_mm_sub_ps(_mm_andnot_ps(sign, posX), r), one),
+                    _mm_cmple_ps(_mm_sub_ps(_mm_andnot_ps(sign, posY), r), one));
+
+                mask |= uint32_t(_mm_movemask_ps(visible)) << half;
+            }
+
+            mask &= laneMask(first, _end);
+            _masks[first / BATCH] = static_cast<uint8_t>(mask);
+            visibleCnt += std::popcount(mask);
+        }
+
+        return visibleCnt;
+    }
+
+    __attribute__((target("avx2")))
+    static uint32_t updateAvx2(const Soa & _soa, uint32_t _begin, uint32_t _end, float _dt, float _radius, uint8_t * _masks) {
+        const __m256 dt = _mm256_set1_ps(_dt), radius = _mm256_set1_ps(_radius);
+        const __m256 one = _mm256_set1_ps(1.0F), minusOne = _mm256_set1_ps(-1.0F), sign = _mm256_set1_ps(-0.0F);
+
+        uint32_t visibleCnt = 0;
+
+        for(uint32_t i = _begin; i< _end; i += BATCH) {
+            // no FMA, positions stay bit identical to the other kernels
+            __m256 posX = _mm256_add_ps(_mm256_load_ps(_soa.posX + i), _mm256_mul_ps(_mm256_load_ps(_soa.velX + i), dt));
+            __m256 posY = _mm256_add_ps(_mm256_load_ps(_soa.posY + i), _mm256_mul_ps(_mm256_load_ps(_soa.velY + i), dt));
+            __m256 rotation = _mm256_add_ps(_mm256_load_ps(_soa.rotation + i), _mm256_mul_ps(_mm256_load_ps(_soa.spin + i), dt));
+
+            __m256 outX = _mm256_or_ps(_mm256_cmp_ps(posX, minusOne, _CMP_LT_OQ), _mm256_cmp_ps(posX, one, _CMP_GT_OQ));
+            __m256 outY = _mm256_or_ps(_mm256_cmp_ps(posY, minusOne, _CMP_LT_OQ), _mm256_cmp_ps(posY, one, _CMP_GT_OQ));
+            _mm256_store_ps(_soa.velX + i, _mm256_xor_ps(_mm256_load_ps(_soa.velX + i), _mm256_and_ps(outX, sign)));
+            _mm256_store_ps(_soa.velY + i, _mm256_xor_ps(_mm256_load_ps(_soa.velY + i), _mm256_and_ps(outY, sign)));
+
+            _mm256_store_ps(_soa.posX + i, posX);
+            _mm256_store_ps(_soa.posY + i, posY);
+            _mm256_store_ps(_soa.rotation + i, rotation);
+
+            __m256 r = _mm256_mul_ps(radius, _mm256_load_ps(_soa.scale + i));
+            __m256 visible = _mm256_and_ps(
+                _mm256_cmp_ps(_mm256_sub_ps(_mm256_andnot_ps(sign, posX), r), one, _CMP_LE_OQ),
+                _mm256_cmp_ps(_mm256_sub_ps(_mm256_andnot_ps(sign, posY), r), one, _CMP_LE_OQ));
+
+            uint32_t mask = uint32_t(_mm256_movemask_ps(visible)) & laneMask(i, _end);
+            _masks[i / BATCH] = static_cast<uint8_t>(mask);
+            visibleCnt += std::popcount(mask);
+        }
+
+        return visibleCnt;
+    }
+#endif
+
+    // the visible instances of [_begin, _end) in order
+    void pack(uint32_t _begin, uint32_t _end, InstanceGpu * _dst) const noexcept {
+        for(uint32_t first = _begin; first< _end; first += BATCH) {
+            for(uint32_t mask = masks_[first / BATCH]; mask != 0; mask &= mask - 1) {
+                uint32_t i = first + std::countr_zero(mask);
+                *_dst++ = {
+                    .transform = { posX_[i], posY_[i], scale_[i], rotation_[i] },
+                    .color = { colorR_[i], colorG_[i], colorB_[i], 1.0F }
+                };
+            }
+        }
+    }
+};
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running one batch of indexed jobs at a time.
+// Jobs see the index of the worker running them, so they can use per-thread resources.
+class JobSystem {
+public:
+    explicit JobSystem(uint32_t _threadCnt) {
+        threadCnt_ = std::max(_threadCnt, 1U);
+
+        for(uint32_t i = 0; i< threadCnt_; ++i)
+            workers_.emplace_back([this, i] { workerLoop(i); });
+    }
+
+    ~JobSystem() {
+        {
+            std::lock_guard lock(mutex_);
+            quit_ = true;
+        }
+        wakeCv_.notify_all();
+
+        for(auto & worker : workers_)
+            worker.join();
+    }
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem & operator=(const JobSystem &) = delete;
+
+    uint32_t threadCnt() const noexcept {
+        return threadCnt_;
+    }
+
+    // runs _job(job, thread) for every job in [0, _jobCnt), returns when all of them finished.
+    // the first exception thrown by a job is rethrown here
+    void run(uint32_t _jobCnt, const std::function<void(uint32_t, uint32_t)> & _job) {
+        if(_jobCnt == 0)
+            return;
+
+        std::unique_lock lock(mutex_);
+
+        job_ = &_job;
+        jobCnt_ = _jobCnt;
+        nextJob_.store(0, std::memory_order_relaxed);
+        remaining_ = _jobCnt;
+        error_ = nullptr;
+        ++generation_;
+
+        wakeCv_.notify_all();
+        // no worker may still be holding on to this batch once we return
+        doneCv_.wait(lock, [this] { return remaining_ == 0 && activeWorkers_ == 0; });
+
+        job_ = nullptr;
+
+        if(error_)
+            std::rethrow_exception(error_);
+    }
+
+    // runs _body(begin, end, thread) over [0, _cnt) split into ranges of _grain, the last one may be shorter.
+    // _grain 0 counts as 1, _cnt may go right up to UINT32_MAX
+    void parallelFor(uint32_t _cnt, uint32_t _grain, const std::function<void(uint32_t, uint32_t, uint32_t)> & _body) {
+        _grain = std::max(_grain, 1U);
+
+        run(_cnt / _grain + (_cnt % _grain != 0), [&](uint32_t _job, uint32_t _thread) {
+            uint32_t begin = _job * _grain;
+            _body(begin, begin + std::min(_grain, _cnt - begin), _thread);
+        });
+    }
+
+private:
+    uint32_t threadCnt_;
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable wakeCv_, doneCv_;
+    bool quit_ = false;
+
+    uint64_t generation_ = 0;
+    const std::function<void(uint32_t, uint32_t)> * job_ = nullptr;
+    uint32_t jobCnt_ = 0;
+    std::atomic<uint32_t> nextJob_ = 0;
+    uint32_t remaining_ = 0;
+    uint32_t activeWorkers_ = 0;
+    std::exception_ptr error_;
+
+    void workerLoop(uint32_t _thread) {
+        uint64_t seenGeneration = 0;
+
+        while(true) {
+            const std::function<void(uint32_t, uint32_t)> * job;
+            uint32_t jobCnt;
+            {
+                std::unique_lock lock(mutex_);
+                wakeCv_.wait(lock, [&] { return quit_ || generation_ != seenGeneration; });
+
+                if(quit_)
+                    return;
+
+                seenGeneration = generation_;
+
+                // woke up after the batch was already finished
+                if(job_ == nullptr)
+                    continue;
+
+                job = job_;
+                jobCnt = jobCnt_;
+                ++activeWorkers_;
+            }
+
+            uint32_t done = 0;
+            std::exception_ptr error;
+
+            for(uint32_t i = nextJob_.fetch_add(1, std::memory_order_relaxed); i< jobCnt;
+                i = nextJob_.fetch_add(1, std::memory_order_relaxed)) {
+                try {
+                    (*job)(i, _thread);
+                } catch(...) {
+                    if(!error)
+                        error = std::current_exception();
+                }
+                ++done;
+            }
+
+            std::lock_guard lock(mutex_);
+            if(error && !error_)
+                error_ = error;
+
+            remaining_ -= done;
+            --activeWorkers_;
+            if(remaining_ == 0 && activeWorkers_ == 0)
+                doneCv_.notify_one();
+        }
+    }
+};
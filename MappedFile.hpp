@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A read-only memory mapping of a whole file, pages are read in on first touch.
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    explicit MappedFile(const std::string & _path) {
+        int fd = ::open(_path.c_str(), O_RDONLY);
+        if(fd < 0)
+            throw std::runtime_error("Failed to open file(\"" + _path + "\")");
+
+        struct stat st;
+        if(::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to stat file(\"" + _path + "\")");
+        }
+        size_ = size_t(st.st_size);
+
+        if(size_ != 0) {
+            void * data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(data == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Failed to map file(\"" + _path + "\")");
+            }
+            data_ = static_cast<const char *>(data);
+
+            // read front to back, let the kernel read ahead
+            ::madvise(data, size_, MADV_SEQUENTIAL);
+        }
+
+        // the mapping keeps the file referenced
+        ::close(fd);
+    }
+
+    ~MappedFile() {
+        if(data_ != nullptr)
+            ::munmap(const_cast<char *>(data_), size_);
+    }
+
+    MappedFile(MappedFile && _other) noexcept
+        : data_(std::exchange(_other.data_, nullptr)), size_(std::exchange(_other.size_, 0)) {}
+
+    MappedFile & operator=(MappedFile && _other) noexcept {
+        std::swap(data_, _other.data_);
+        std::swap(size_, _other.size_);
+        return *this;
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    const char * data() const noexcept {
+        return data_;
+    }
+
+    size_t size() const noexcept {
+        return size_;
+    }
+
+private:
+    const char * data_ = nullptr;
+    size_t size_ = 0;
+};
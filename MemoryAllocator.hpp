@@ -0,0 +1,476 @@
+#pragma once
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "DeviceCapabilities.hpp"
+
+// Sub-allocates resources out of large VkDeviceMemory blocks, one set of blocks per memory type.
+// Linear (buffers) and optimal-tiling (images) resources never share a block,
+// which keeps bufferImageGranularity out of the picture entirely.
+class MemoryAllocator {
+public:
+    enum class ResourceKind : uint32_t {
+        Linear = 0,
+        Optimal = 1
+    };
+
+    struct Block;
+
+    struct Allocation {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        // host-visible memory stays mapped for its whole lifetime
+        void * mapped = nullptr;
+        uint32_t memoryTypeIndex = 0;
+
+        Block * block = nullptr; // nullptr: dedicated allocation
+    };
+
+    struct Block {
+        VkDeviceMemory memory;
+        VkDeviceSize size;
+        void * mapped;
+        VkDeviceSize used = 0;
+        uint32_t allocationCnt = 0;
+        // offset -> size, coalesced on free
+        std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+    };
+
+    struct TypeStats {
+        uint32_t memoryTypeIndex;
+        uint32_t blockCnt = 0;
+        VkDeviceSize blockBytes = 0;
+        VkDeviceSize usedBytes = 0;
+        uint32_t allocationCnt = 0;
+        VkDeviceSize largestFreeRange = 0;
+        // 0: all free space is one range, towards 1: free space is scattered in small ranges
+        double fragmentation = 0.0;
+        uint32_t dedicatedCnt = 0;
+        VkDeviceSize dedicatedBytes = 0;
+    };
+
+    static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ULL << 20;
+
+    void init(VkDevice _device, const DeviceCapabilities & _caps, VkDeviceSize _blockSize = DEFAULT_BLOCK_SIZE) {
+        device_ = _device;
+        blockSize_ = _blockSize;
+
+        memProps_ = _caps.memoryProperties;
+        nonCoherentAtomSize_ = _caps.properties.limits.nonCoherentAtomSize;
+        maxAllocationCnt_ = _caps.properties.limits.maxMemoryAllocationCount;
+    }
+
+    void destroy() noexcept {
+        for(auto & pools : pools_) {
+            for(auto & blocks : pools) {
+                for(auto & block : blocks)
+                    vkFreeMemory(device_, block->memory, nullptr);
+                blocks.clear();
+            }
+        }
+
+        for(auto & [memory, dedicated] : dedicated_)
+            vkFreeMemory(device_, memory, nullptr);
+        dedicated_.clear();
+
+        deviceAllocationCnt_ = 0;
+    }
+
+    const VkPhysicalDeviceMemoryProperties & memoryProperties() const noexcept {
+        return memProps_;
+    }
+
+    // _preferred flags are dropped when no memory type offers them together with _required
+    std::optional<uint32_t> findMemoryType(uint32_t _typeBits, VkMemoryPropertyFlags _required,
+        VkMemoryPropertyFlags _preferred = 0) const noexcept {
+        for(auto flags : { _required | _preferred, _required }) {
+            for(uint32_t i = 0; i< memProps_.memoryTypeCount; ++i) {
+                if((_typeBits & (1U << i)) && (memProps_.memoryTypes[i].propertyFlags & flags) == flags)
+                    return i;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    Allocation allocate(const VkMemoryRequirements & _reqs, ResourceKind _kind,
+        VkMemoryPropertyFlags _required, VkMemoryPropertyFlags _preferred = 0,
+        bool _dedicated = false, VkImage _dedicatedImage = VK_NULL_HANDLE, VkBuffer _dedicatedBuffer = VK_NULL_HANDLE) {
+        auto typeIndex = findMemoryType(_reqs.memoryTypeBits, _required, _preferred);
+        if(!typeIndex)
+            throw std::runtime_error("Failed to find suitable memory type");
+
+        std::lock_guard lock(mutex_);
+
+        // large resources would mostly waste the rest of a block.
+        // lazily allocated memory is committed per allocation, pooling it would defeat that
+        bool lazy = memProps_.memoryTypes[*typeIndex].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+        if(_dedicated || lazy || _reqs.size > blockSize_ / 2)
+            return allocateDedicated(_reqs.size, *typeIndex, _dedicatedImage, _dedicatedBuffer);
+
+        auto & blocks = pools_[*typeIndex][static_cast<uint32_t>(_kind)];
+
+        for(auto & block : blocks) {
+            if(auto allocation = allocateFromBlock(*block, _reqs.size, _reqs.alignment)) {
+                allocation->memoryTypeIndex = *typeIndex;
+                return *allocation;
+            }
+        }
+
+        blocks.push_back(createBlock(*typeIndex));
+
+        auto allocation = allocateFromBlock(*blocks.back(), _reqs.size, _reqs.alignment);
+        allocation->memoryTypeIndex = *typeIndex;
+        return *allocation;
+    }
+
+    void free(Allocation & _allocation) noexcept {
+        if(_allocation.memory == VK_NULL_HANDLE)
+            return;
+
+        std::lock_guard lock(mutex_);
+
+        if(_allocation.block == nullptr) {
+            vkFreeMemory(device_, _allocation.memory, nullptr);
+            dedicated_.erase(_allocation.memory);
+            --deviceAllocationCnt_;
+        } else {
+            auto & block = *_allocation.block;
+            block.used -= _allocation.size;
+            --block.allocationCnt;
+
+            auto [it, inserted] = block.freeRanges.emplace(_allocation.offset, _allocation.size);
+
+            // merge with the following range
+            auto next = std::next(it);
+            if(next != block.freeRanges.end() && it->first + it->second == next->first) {
+                it->second += next->second;
+                block.freeRanges.erase(next);
+            }
+
+            // and the preceding one
+            if(it != block.freeRanges.begin()) {
+                auto prev = std::prev(it);
+                if(prev->first + prev->second == it->first) {
+                    prev->second += it->second;
+                    block.freeRanges.erase(it);
+                }
+            }
+        }
+
+        _allocation = {};
+    }
+
+    std::pair<VkBuffer, Allocation> createBuffer(VkDeviceSize _size, VkBufferUsageFlags _usage,
+        VkMemoryPropertyFlags _required, VkMemoryPropertyFlags _preferred = 0) {
+        VkBufferCreateInfo bufferInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = _size,
+            .usage = _usage,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+        };
+
+        VkBuffer buffer;
+        if(vkCreateBuffer(device_, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create buffer");
+
+        VkMemoryDedicatedRequirements dedicatedReqs = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS
+        };
+        VkMemoryRequirements2 memReqs = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+            .pNext = &dedicatedReqs
+        };
+        VkBufferMemoryRequirementsInfo2 reqsInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2,
+            .buffer = buffer
+        };
+        vkGetBufferMemoryRequirements2(device_, &reqsInfo, &memReqs);
+
+        auto allocation = allocate(memReqs.memoryRequirements, ResourceKind::Linear, _required, _preferred,
+            dedicatedReqs.prefersDedicatedAllocation || dedicatedReqs.requiresDedicatedAllocation,
+            VK_NULL_HANDLE, buffer);
+
+        if(vkBindBufferMemory(device_, buffer, allocation.memory, allocation.offset) != VK_SUCCESS)
+            throw std::runtime_error("Failed to bind buffer memory");
+
+        return { buffer, allocation };
+    }
+
+    std::pair<VkImage, Allocation> createImage(const VkImageCreateInfo & _imageInfo,
+        VkMemoryPropertyFlags _required, VkMemoryPropertyFlags _preferred = 0) {
+        VkImage image;
+        if(vkCreateImage(device_, &_imageInfo, nullptr, &image) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create image");
+
+        VkMemoryDedicatedRequirements dedicatedReqs = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS
+        };
+        VkMemoryRequirements2 memReqs = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+            .pNext = &dedicatedReqs
+        };
+        VkImageMemoryRequirementsInfo2 reqsInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2,
+            .image = image
+        };
+        vkGetImageMemoryRequirements2(device_, &reqsInfo, &memReqs);
+
+        auto kind = _imageInfo.tiling == VK_IMAGE_TILING_LINEAR ? ResourceKind::Linear : ResourceKind::Optimal;
+        auto allocation = allocate(memReqs.memoryRequirements, kind, _required, _preferred,
+            dedicatedReqs.prefersDedicatedAllocation || dedicatedReqs.requiresDedicatedAllocation,
+            image, VK_NULL_HANDLE);
+
+        if(vkBindImageMemory(device_, image, allocation.memory, allocation.offset) != VK_SUCCESS)
+            throw std::runtime_error("Failed to bind image memory");
+
+        return { image, allocation };
+    }
+
+    void destroyBuffer(VkBuffer _buffer, Allocation & _allocation) noexcept {
+        vkDestroyBuffer(device_, _buffer, nullptr);
+        free(_allocation);
+    }
+
+    void destroyImage(VkImage _image, Allocation & _allocation) noexcept {
+        vkDestroyImage(device_, _image, nullptr);
+        free(_allocation);
+    }
+
+    // only needed for memory types without HOST_COHERENT
+    void flush(const Allocation & _allocation, VkDeviceSize _offset = 0, VkDeviceSize _size = VK_WHOLE_SIZE) {
+        if(memProps_.memoryTypes[_allocation.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+            return;
+
+        auto range = atomAlignedRange(_allocation, _offset, _size);
+        vkFlushMappedMemoryRanges(device_, 1, &range);
+    }
+
+    void invalidate(const Allocation & _allocation, VkDeviceSize _offset = 0, VkDeviceSize _size = VK_WHOLE_SIZE) {
+        if(memProps_.memoryTypes[_allocation.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+            return;
+
+        auto range = atomAlignedRange(_allocation, _offset, _size);
+        vkInvalidateMappedMemoryRanges(device_, 1, &range);
+    }
+
+    bool isLazilyAllocated(const Allocation & _allocation) const noexcept {
+        return memProps_.memoryTypes[_allocation.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+    }
+
+    // what the device actually backs the allocation with, only lazily allocated memory may stay below its size
+    VkDeviceSize committedBytes(const Allocation & _allocation) const noexcept {
+        if(!isLazilyAllocated(_allocation))
+            return _allocation.size;
+
+        VkDeviceSize committed = 0;
+        vkGetDeviceMemoryCommitment(device_, _allocation.memory, &committed);
+        return committed;
+    }
+
+    std::vector<TypeStats> stats() {
+        std::lock_guard lock(mutex_);
+        std::vector<TypeStats> result;
+
+        for(uint32_t typeIndex = 0; typeIndex< memProps_.memoryTypeCount; ++typeIndex) {
+            TypeStats stats = { .memoryTypeIndex = typeIndex };
+            VkDeviceSize freeBytes = 0;
+
+            for(auto & blocks : pools_[typeIndex]) {
+                for(auto & block : blocks) {
+                    ++stats.blockCnt;
+                    stats.blockBytes += block->size;
+                    stats.usedBytes += block->used;
+                    stats.allocationCnt += block->allocationCnt;
+
+                    for(auto [offset, size] : block->freeRanges) {
+                        freeBytes += size;
+                        stats.largestFreeRange = std::max(stats.largestFreeRange, size);
+                    }
+                }
+            }
+
+            for(auto & [memory, dedicated] : dedicated_) {
+                if(dedicated.first != typeIndex)
+                    continue;
+                ++stats.dedicatedCnt;
+                stats.dedicatedBytes += dedicated.second;
+            }
+
+            if(freeBytes != 0)
+                stats.fragmentation = 1.0 - double(stats.largestFreeRange) / freeBytes;
+
+            if(stats.blockCnt != 0 || stats.dedicatedCnt != 0)
+                result.push_back(stats);
+        }
+
+        return result;
+    }
+
+    void logStats() {
+        constexpr double MiB = 1024.0 * 1024.0;
+
+        std::cout << "Device memory: " << deviceAllocationCnt_ << " of max " << maxAllocationCnt_ << " allocations\n";
+        for(const auto & stats : stats()) {
+            std::cout << "  type " << stats.memoryTypeIndex << ": "
+                << stats.blockCnt << " block(s), " << stats.usedBytes / MiB << " / " << stats.blockBytes / MiB
+                << " MiB used by " << stats.allocationCnt << " allocation(s), largest free "
+                << stats.largestFreeRange / MiB << " MiB, fragmentation " << stats.fragmentation * 100.0 << "%, "
+                << stats.dedicatedCnt << " dedicated (" << stats.dedicatedBytes / MiB << " MiB)\n";
+        }
+    }
+
+private:
+    VkDevice device_ = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memProps_ {};
+    VkDeviceSize blockSize_ = DEFAULT_BLOCK_SIZE;
+    VkDeviceSize nonCoherentAtomSize_ = 1;
+    uint32_t maxAllocationCnt_ = 0;
+    uint32_t deviceAllocationCnt_ = 0;
+
+    std::mutex mutex_;
+
+    // [memory type][resource kind]
+    std::vector<std::unique_ptr<Block>> pools_[VK_MAX_MEMORY_TYPES][2];
+    // memory -> { memory type, size }
+    std::map<VkDeviceMemory, std::pair<uint32_t, VkDeviceSize>> dedicated_;
+
+    static VkDeviceSize alignUp(VkDeviceSize _value, VkDeviceSize _alignment) noexcept {
+        return (_value + _alignment - 1) / _alignment * _alignment;
+    }
+
+    VkMappedMemoryRange atomAlignedRange(const Allocation & _allocation, VkDeviceSize _offset, VkDeviceSize _size) const noexcept {
+        VkDeviceSize begin = _allocation.offset + _offset;
+        VkDeviceSize end = _size == VK_WHOLE_SIZE ? _allocation.offset + _allocation.size : begin + _size;
+
+        begin = begin / nonCoherentAtomSize_ * nonCoherentAtomSize_;
+        end = alignUp(end, nonCoherentAtomSize_);
+
+        // the block (or dedicated allocation) may end off an atom boundary
+        VkDeviceSize memorySize = _allocation.block != nullptr ? _allocation.block->size : _allocation.size;
+        bool toEnd = end >= memorySize;
+
+        return {
+            .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+            .memory = _allocation.memory,
+            .offset = begin,
+            .size = toEnd ? VK_WHOLE_SIZE : end - begin
+        };
+    }
+
+    VkDeviceMemory allocateDeviceMemory(VkDeviceSize _size, uint32_t _typeIndex, const void * _next) {
+        if(deviceAllocationCnt_ >= maxAllocationCnt_)
+            throw std::runtime_error("Exceeded maxMemoryAllocationCount");
+
+        VkMemoryAllocateInfo allocInfo = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .pNext = _next,
+            .allocationSize = _size,
+            .memoryTypeIndex = _typeIndex
+        };
+
+        VkDeviceMemory memory;
+        if(vkAllocateMemory(device_, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+            throw std::runtime_error("Failed to allocate device memory(" + std::to_string(_size) + " bytes)");
+
+        ++deviceAllocationCnt_;
+        return memory;
+    }
+
+    void * mapIfHostVisible(VkDeviceMemory _memory, uint32_t _typeIndex) {
+        if(!(memProps_.memoryTypes[_typeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+            return nullptr;
+
+        void * mapped;
+        if(vkMapMemory(device_, _memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS)
+            throw std::runtime_error("Failed to map device memory");
+
+        return mapped;
+    }
+
+    std::unique_ptr<Block> createBlock(uint32_t _typeIndex) {
+        auto block = std::make_unique<Block>();
+        block->size = blockSize_;
+        block->memory = allocateDeviceMemory(blockSize_, _typeIndex, nullptr);
+        block->mapped = mapIfHostVisible(block->memory, _typeIndex);
+        block->freeRanges.emplace(0, blockSize_);
+
+        return block;
+    }
+
+    Allocation allocateDedicated(VkDeviceSize _size, uint32_t _typeIndex, VkImage _image, VkBuffer _buffer) {
+        VkMemoryDedicatedAllocateInfo dedicatedInfo = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+            .image = _image,
+            .buffer = _buffer
+        };
+        bool hasResource = _image != VK_NULL_HANDLE || _buffer != VK_NULL_HANDLE;
+
+        Allocation allocation;
+        allocation.memory = allocateDeviceMemory(_size, _typeIndex, hasResource ? &dedicatedInfo : nullptr);
+        allocation.size = _size;
+        allocation.mapped = mapIfHostVisible(allocation.memory, _typeIndex);
+        allocation.memoryTypeIndex = _typeIndex;
+
+        dedicated_.emplace(allocation.memory, std::make_pair(_typeIndex, _size));
+
+        return allocation;
+    }
+
+    // best fit over the block's free ranges
+    std::optional<Allocation> allocateFromBlock(Block & _block, VkDeviceSize _size, VkDeviceSize _alignment) {
+        auto best = _block.freeRanges.end();
+        VkDeviceSize bestLeftover = 0;
+
+        for(auto it = _block.freeRanges.begin(); it != _block.freeRanges.end(); ++it) {
+            auto [offset, size] = *it;
+            VkDeviceSize aligned = alignUp(offset, _alignment);
+
+            if(aligned + _size > offset + size)
+                continue;
+
+            VkDeviceSize leftover = size - _size;
+            if(best == _block.freeRanges.end() || leftover < bestLeftover) {
+                best = it;
+                bestLeftover = leftover;
+            }
+        }
+
+        if(best == _block.freeRanges.end())
+            return std::nullopt;
+
+        auto [offset, size] = *best;
+        VkDeviceSize aligned = alignUp(offset, _alignment);
+        _block.freeRanges.erase(best);
+
+        // keep the alignment padding and the tail free
+        if(aligned > offset)
+            _block.freeRanges.emplace(offset, aligned - offset);
+        if(aligned + _size < offset + size)
+            _block.freeRanges.emplace(aligned + _size, offset + size - aligned - _size);
+
+        _block.used += _size;
+        ++_block.allocationCnt;
+
+        Allocation allocation;
+        allocation.memory = _block.memory;
+        allocation.offset = aligned;
+        allocation.size = _size;
+        allocation.mapped = _block.mapped != nullptr ? static_cast<char *>(_block.mapped) + aligned : nullptr;
+        allocation.block = &_block;
+
+        return allocation;
+    }
+};
@@ -0,0 +1,316 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "PipelineState.hpp"
+
+// Compiles graphics pipelines on a few worker threads, all sharing one pipeline cache.
+// Finished pipelines are handed back through a lock-free queue, so the render thread can pick them up
+// once per frame without ever blocking on a compile.
+class PipelineCompiler {
+public:
+    struct Result {
+        uint64_t ticket;
+        VkPipeline pipeline = VK_NULL_HANDLE; // VK_NULL_HANDLE: failed, see error
+        double compileMs = 0.0;
+        // from VK_EXT_pipeline_creation_feedback, nullopt without it or when the driver didn't say
+        std::optional<bool> cacheHit;
+        std::string error;
+    };
+
+    using ShaderLoader = std::function<VkShaderModule(std::string_view)>;
+
+    // _loadShader is called from the worker threads.
+    // _creationFeedback: VK_EXT_pipeline_creation_feedback is enabled, results then report cache hits
+    void init(VkDevice _device, VkPipelineCache _cache, ShaderLoader _loadShader, uint32_t _threadCnt,
+        bool _creationFeedback) {
+        device_ = _device;
+        cache_ = _cache;
+        creationFeedback_ = _creationFeedback;
+        loadShader_ = std::move(_loadShader);
+        quit_ = false;
+
+        for(uint32_t i = 0; i< std::max(_threadCnt, 1U); ++i)
+            workers_.emplace_back([this] { workerLoop(); });
+    }
+
+    // finishes the compiles already running, drops the queued ones and destroys results nobody drained
+    void destroy() noexcept {
+        {
+            std::lock_guard lock(mutex_);
+            quit_ = true;
+            pending_.clear();
+        }
+        wakeCv_.notify_all();
+
+        for(auto & worker : workers_)
+            worker.join();
+        workers_.clear();
+
+        for(auto & result : takeReady())
+            vkDestroyPipeline(device_, result.pipeline, nullptr);
+    }
+
+    // returns the ticket its Result will carry
+    uint64_t submit(GraphicsPipelineDesc _desc) {
+        uint64_t ticket;
+        {
+            std::lock_guard lock(mutex_);
+            ticket = ++lastTicket_;
+            pending_.push_back({ ticket, std::move(_desc) });
+            ++inFlight_;
+        }
+        wakeCv_.notify_one();
+
+        return ticket;
+    }
+
+    // the results finished since the last call, in completion order, never blocks.
+    // pipelines of the results belong to the caller
+    std::vector<Result> drain() {
+        return takeReady();
+    }
+
+    // blocks until every submitted pipeline sits in the ready queue
+    void waitIdle() {
+        std::unique_lock lock(mutex_);
+        idleCv_.wait(lock, [this] { return inFlight_ == 0; });
+    }
+
+private:
+    struct Request {
+        uint64_t ticket;
+        GraphicsPipelineDesc desc;
+    };
+
+    // intrusive stack pushed by the workers, the render thread takes it whole, so there is no ABA
+    struct ReadyNode {
+        Result result;
+        ReadyNode * next = nullptr;
+    };
+
+    VkDevice device_ = VK_NULL_HANDLE;
+    VkPipelineCache cache_ = VK_NULL_HANDLE;
+    ShaderLoader loadShader_;
+    bool creationFeedback_ = false;
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wakeCv_, idleCv_;
+    std::deque<Request> pending_;
+    uint64_t lastTicket_ = 0;
+    uint32_t inFlight_ = 0; // submitted, not yet in the ready queue
+    bool quit_ = false;
+
+    std::atomic<ReadyNode *> ready_ = nullptr;
+
+    void workerLoop() {
+        while(true) {
+            Request request;
+            {
+                std::unique_lock lock(mutex_);
+                wakeCv_.wait(lock, [this] { return quit_ || !pending_.empty(); });
+
+                if(quit_)
+                    return;
+
+                request = std::move(pending_.front());
+                pending_.pop_front();
+            }
+
+            auto node = new ReadyNode { .result = compile(request) };
+
+            node->next = ready_.load(std::memory_order_relaxed);
+            while(!ready_.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+                ;
+
+            {
+                std::lock_guard lock(mutex_);
+                --inFlight_;
+            }
+            idleCv_.notify_all();
+        }
+    }
+
+    std::vector<Result> takeReady() {
+        ReadyNode * node = ready_.exchange(nullptr, std::memory_order_acquire);
+
+        // the stack holds the newest first
+        std::vector<Result> results;
+        for(; node != nullptr; ) {
+            results.push_back(std::move(node->result));
+            auto next = node->next;
+            delete node;
+            node = next;
+        }
+        std::reverse(results.begin(), results.end());
+
+        return results;
+    }
+
+    Result compile(const Request & _request) noexcept {
+        Result result { .ticket = _request.ticket };
+        const auto & desc = _request.desc;
+
+        VkShaderModule vertShaderMod = VK_NULL_HANDLE, fragShaderMod = VK_NULL_HANDLE;
+
+        try {
+            vertShaderMod = loadShader_(desc.vertexShader);
+            fragShaderMod = loadShader_(desc.fragmentShader);
+        } catch(const std::exception & e) {
+            result.error = e.what();
+            vkDestroyShaderModule(device_, vertShaderMod, nullptr);
+            return result;
+        }
+
+        VkPipelineShaderStageCreateInfo shaderStages[] = {
+            {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+                .module = fragShaderMod,
+                .pName = "main"
+            }, {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_VERTEX_BIT,
+                .module = vertShaderMod,
+                .pName = "main"
+            }
+        };
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+            .vertexBindingDescriptionCount = static_cast<uint32_t>(desc.vertexBindings.size()),
+            .pVertexBindingDescriptions = desc.vertexBindings.data(),
+            .vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.vertexAttributes.size()),
+            .pVertexAttributeDescriptions = desc.vertexAttributes.data()
+        };
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+            .topology = desc.topology,
+            .primitiveRestartEnable = VK_FALSE
+        };
+
+        // set while recording, so the pipeline outlives swapchain recreation
+        VkPipelineViewportStateCreateInfo viewportState = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+            .viewportCount = 1,
+            .scissorCount = 1
+        };
+
+        VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+        VkPipelineDynamicStateCreateInfo dynamicState = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+            .dynamicStateCount = std::extent_v<decltype(dynamicStates)>,
+            .pDynamicStates = dynamicStates
+        };
+
+        VkPipelineRasterizationStateCreateInfo rasterizer = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+            .depthClampEnable = VK_FALSE,
+            .rasterizerDiscardEnable = VK_FALSE,
+            .polygonMode = desc.polygonMode,
+            .cullMode = desc.cullMode,
+            .frontFace = desc.frontFace,
+            .depthBiasEnable = VK_FALSE,
+            .lineWidth = 1.0F
+        };
+
+        VkPipelineMultisampleStateCreateInfo multiSampling = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+            .rasterizationSamples = desc.samples,
+            .sampleShadingEnable = VK_FALSE
+        };
+
+        // less or equal keeps draw order among equal depths, everything is flat so far
+        VkPipelineDepthStencilStateCreateInfo depthStencil = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+            .depthTestEnable = desc.depthTest,
+            .depthWriteEnable = desc.depthTest,
+            .depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
+            .depthBoundsTestEnable = VK_FALSE,
+            .stencilTestEnable = VK_FALSE
+        };
+
+        VkPipelineColorBlendAttachmentState colorBlendAttachment = {
+            .blendEnable = desc.blend.enable,
+            .srcColorBlendFactor = desc.blend.srcColor,
+            .dstColorBlendFactor = desc.blend.dstColor,
+            .colorBlendOp = desc.blend.colorOp,
+            .srcAlphaBlendFactor = desc.blend.srcAlpha,
+            .dstAlphaBlendFactor = desc.blend.dstAlpha,
+            .alphaBlendOp = desc.blend.alphaOp,
+            .colorWriteMask = desc.blend.writeMask
+        };
+
+        VkPipelineColorBlendStateCreateInfo colorBlending = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+            .logicOpEnable = VK_FALSE,
+            .logicOp = VK_LOGIC_OP_COPY,
+            .attachmentCount = 1,
+            .pAttachments = &colorBlendAttachment,
+            .blendConstants = { 0.0F, 0.0F, 0.0F, 0.0F }
+        };
+
+        // the stage feedbacks aren't read, the extension wants one per stage
+        VkPipelineCreationFeedbackEXT feedback {}, stageFeedbacks[std::extent_v<decltype(shaderStages)>] {};
+        VkPipelineCreationFeedbackCreateInfoEXT feedbackInfo = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT,
+            .pPipelineCreationFeedback = &feedback,
+            .pipelineStageCreationFeedbackCount = std::extent_v<decltype(stageFeedbacks)>,
+            .pPipelineStageCreationFeedbacks = stageFeedbacks
+        };
+
+        VkGraphicsPipelineCreateInfo pipelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+            .pNext = creationFeedback_ ? &feedbackInfo : nullptr,
+            .stageCount = std::extent_v<decltype(shaderStages)>,
+            .pStages = shaderStages,
+            .pVertexInputState = &vertexInputInfo,
+            .pInputAssemblyState = &inputAssembly,
+            .pViewportState = &viewportState,
+            .pRasterizationState = &rasterizer,
+            .pMultisampleState = &multiSampling,
+            .pDepthStencilState = &depthStencil,
+            .pColorBlendState = &colorBlending,
+            .pDynamicState = &dynamicState,
+            .layout = desc.layout,
+            .renderPass = desc.renderPass,
+            .subpass = desc.subpass,
+            .basePipelineHandle = VK_NULL_HANDLE
+        };
+
+        auto start = std::chrono::steady_clock::now();
+
+        if(vkCreateGraphicsPipelines(device_, cache_, 1, &pipelineInfo, nullptr, &result.pipeline) != VK_SUCCESS) {
+            result.pipeline = VK_NULL_HANDLE;
+            result.error = "Failed to create graphics pipeline(" + desc.vertexShader + ", " + desc.fragmentShader + ")";
+        }
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        result.compileMs = elapsed.count();
+        if(result.pipeline != VK_NULL_HANDLE && (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT))
+            result.cacheHit = (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT) != 0;
+
+        vkDestroyShaderModule(device_, fragShaderMod, nullptr);
+        vkDestroyShaderModule(device_, vertShaderMod, nullptr);
+
+        return result;
+    }
+};
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// Plain descriptions of render pass, pipeline layout and graphics pipeline state.
+// Equal descriptions make equal objects, PipelineStateCache keys on them.
+
+inline bool operator==(const VkVertexInputBindingDescription & _a, const VkVertexInputBindingDescription & _b) noexcept {
+    return _a.binding == _b.binding && _a.stride == _b.stride && _a.inputRate == _b.inputRate;
+}
+
+inline bool operator==(const VkVertexInputAttributeDescription & _a, const VkVertexInputAttributeDescription & _b) noexcept {
+    return _a.location == _b.location && _a.binding == _b.binding && _a.format == _b.format && _a.offset == _b.offset;
+}
+
+inline bool operator==(const VkPushConstantRange & _a, const VkPushConstantRange & _b) noexcept {
+    return _a.stageFlags == _b.stageFlags && _a.offset == _b.offset && _a.size == _b.size;
+}
+
+// FNV-1a fed field by field, so struct padding never ends up in a hash
+class StateHasher {
+public:
+    StateHasher & add(uint64_t _value) noexcept {
+        for(auto i = 0; i< 8; ++i) {
+            hash_ ^= (_value >> (i * 8)) & 0xFF;
+            hash_ *= PRIME;
+        }
+        return *this;
+    }
+
+    StateHasher & add(std::string_view _str) noexcept {
+        add(_str.size());
+        for(char c : _str) {
+            hash_ ^= uint8_t(c);
+            hash_ *= PRIME;
+        }
+        return *this;
+    }
+
+    // dispatchable handles are pointers, non-dispatchable ones pointers or uint64_t depending on the platform
+    template<typename Handle>
+    StateHasher & addHandle(Handle _handle) noexcept {
+        if constexpr(std::is_pointer_v<Handle>)
+            return add(uint64_t(reinterpret_cast<uintptr_t>(_handle)));
+        else
+            return add(uint64_t(_handle));
+    }
+
+    uint64_t value() const noexcept {
+        return hash_;
+    }
+
+private:
+    static constexpr uint64_t PRIME = 1099511628211ULL;
+    uint64_t hash_ = 14695981039346656037ULL;
+};
+
+// a single subpass writing one color target, optionally through depth and a multisampled color attachment.
+// attachments: color (multisampled with samples > 1), depth if any, the single sampled resolve target with samples > 1
+struct RenderPassDesc {
+    VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED; // VK_FORMAT_UNDEFINED: no depth
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    // of the color target, the one the frame ends up in
+    VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    VkAttachmentStoreOp storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    VkImageLayout finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    bool operator==(const RenderPassDesc &) const = default;
+
+    uint64_t hash() const noexcept {
+        return StateHasher().add(colorFormat).add(depthFormat).add(samples).add(loadOp).add(storeOp).add(finalLayout).value();
+    }
+};
+
+struct PipelineLayoutDesc {
+    std::vector<VkDescriptorSetLayout> setLayouts;
+    std::vector<VkPushConstantRange> pushConstantRanges;
+
+    bool operator==(const PipelineLayoutDesc &) const = default;
+
+    uint64_t hash() const noexcept {
+        StateHasher hasher;
+        hasher.add(setLayouts.size());
+        for(auto setLayout : setLayouts)
+            hasher.addHandle(setLayout);
+
+        hasher.add(pushConstantRanges.size());
+        for(const auto & range : pushConstantRanges)
+            hasher.add(range.stageFlags).add(range.offset).add(range.size);
+
+        return hasher.value();
+    }
+};
+
+// of the single color attachment, the defaults write without blending
+struct BlendState {
+    VkBool32 enable = VK_FALSE;
+    VkBlendFactor srcColor = VK_BLEND_FACTOR_ONE, dstColor = VK_BLEND_FACTOR_ZERO;
+    VkBlendOp colorOp = VK_BLEND_OP_ADD;
+    VkBlendFactor srcAlpha = VK_BLEND_FACTOR_ONE, dstAlpha = VK_BLEND_FACTOR_ZERO;
+    VkBlendOp alphaOp = VK_BLEND_OP_ADD;
+    VkColorComponentFlags writeMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT
+        | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+    // non-premultiplied "over"
+    static BlendState alpha() noexcept {
+        return {
+            .enable = VK_TRUE,
+            .srcColor = VK_BLEND_FACTOR_SRC_ALPHA,
+            .dstColor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+            .srcAlpha = VK_BLEND_FACTOR_ONE,
+            .dstAlpha = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA
+        };
+    }
+
+    bool operator==(const BlendState &) const = default;
+};
+
+// what varies between our graphics pipelines, viewport/scissor are always dynamic
+struct GraphicsPipelineDesc {
+    std::string vertexShader, fragmentShader; // names for the shader loader
+    std::vector<VkVertexInputBindingDescription> vertexBindings;
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT; // has to match the render pass
+    VkBool32 depthTest = VK_FALSE; // test and write, the render pass needs depth
+    BlendState blend;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    // pipelines work with any compatible render pass, as render passes are deduplicated the handle stands for that
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    uint32_t subpass = 0;
+
+    bool operator==(const GraphicsPipelineDesc &) const = default;
+
+    uint64_t hash() const noexcept {
+        StateHasher hasher;
+        hasher.add(vertexShader).add(fragmentShader);
+
+        hasher.add(vertexBindings.size());
+        for(const auto & binding : vertexBindings)
+            hasher.add(binding.binding).add(binding.stride).add(binding.inputRate);
+
+        hasher.add(vertexAttributes.size());
+        for(const auto & attribute : vertexAttributes)
+            hasher.add(attribute.location).add(attribute.binding).add(attribute.format).add(attribute.offset);
+
+        hasher.add(topology).add(polygonMode).add(cullMode).add(frontFace).add(samples).add(depthTest);
+        hasher.add(blend.enable).add(blend.srcColor).add(blend.dstColor).add(blend.colorOp)
+            .add(blend.srcAlpha).add(blend.dstAlpha).add(blend.alphaOp).add(blend.writeMask);
+        hasher.addHandle(layout).addHandle(renderPass).add(subpass);
+
+        return hasher.value();
+    }
+};
+
+// for the unordered containers
+struct StateHash {
+    template<typename Desc>
+    size_t operator()(const Desc & _desc) const noexcept {
+        return size_t(_desc.hash());
+    }
+};
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "PipelineCompiler.hpp"
+#include "PipelineState.hpp"
+
+// Owns render passes, pipeline layouts and graphics pipelines, one per distinct description.
+// A lookup is a hash probe; a pipeline miss queues the compile and returns VK_NULL_HANDLE until update() installs it,
+// or for good when the compile failed.
+// Used by one thread at a time.
+class PipelineStateCache {
+public:
+    struct Counters {
+        uint64_t hits = 0, misses = 0;
+    };
+
+    struct Stats {
+        Counters renderPasses, layouts, pipelines;
+    };
+
+    void init(VkDevice _device, PipelineCompiler & _compiler) {
+        device_ = _device;
+        compiler_ = &_compiler;
+    }
+
+    // the compiler must be destroyed first, so no compile finishes afterwards
+    void destroy() noexcept {
+        for(auto & [desc, entry] : pipelines_)
+            vkDestroyPipeline(device_, entry.pipeline, nullptr);
+        pipelines_.clear();
+        compiling_.clear();
+
+        for(auto & [desc, layout] : layouts_)
+            vkDestroyPipelineLayout(device_, layout, nullptr);
+        layouts_.clear();
+
+        for(auto & [desc, renderPass] : renderPasses_)
+            vkDestroyRenderPass(device_, renderPass, nullptr);
+        renderPasses_.clear();
+    }
+
+    VkRenderPass renderPass(const RenderPassDesc & _desc) {
+        if(auto it = renderPasses_.find(_desc); it != renderPasses_.end()) {
+            ++stats_.renderPasses.hits;
+            return it->second;
+        }
+        ++stats_.renderPasses.misses;
+
+        bool multisampled = _desc.samples != VK_SAMPLE_COUNT_1_BIT;
+        bool depth = _desc.depthFormat != VK_FORMAT_UNDEFINED;
+
+        // multisampled color and depth only live within the pass, nothing of them is stored
+        std::vector<VkAttachmentDescription> attachments;
+        attachments.push_back({
+            .format = _desc.colorFormat,
+            .samples = _desc.samples,
+            .loadOp = _desc.loadOp,
+            .storeOp = multisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : _desc.storeOp,
+            .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+            .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .finalLayout = multisampled ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : _desc.finalLayout
+        });
+
+        if(depth) {
+            attachments.push_back({
+                .format = _desc.depthFormat,
+                .samples = _desc.samples,
+                .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+                .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+            });
+        }
+
+        // resolved at the end of the subpass, its previous contents are overwritten entirely
+        if(multisampled) {
+            attachments.push_back({
+                .format = _desc.colorFormat,
+                .samples = VK_SAMPLE_COUNT_1_BIT,
+                .loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                .storeOp = _desc.storeOp,
+                .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                .finalLayout = _desc.finalLayout
+            });
+        }
+
+        VkAttachmentReference colorAttachmentRef = {
+            .attachment = 0,
+            .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+        }, depthAttachmentRef = {
+            .attachment = 1,
+            .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+        }, resolveAttachmentRef = {
+            .attachment = depth ? 2U : 1U,
+            .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+        };
+
+        VkSubpassDescription subpass = {
+            .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+            .colorAttachmentCount = 1,
+            .pColorAttachments = &colorAttachmentRef,
+            .pResolveAttachments = multisampled ? &resolveAttachmentRef : nullptr,
+            .pDepthStencilAttachment = depth ? &depthAttachmentRef : nullptr
+        };
+
+        bool readBack = _desc.finalLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+        VkSubpassDependency dependencies[] = {
+            // the previous frame's writes to the transient attachments, shared by all frames,
+            // and the image acquire, which the semaphore wait at color output covers
+            {
+                .srcSubpass = VK_SUBPASS_EXTERNAL,
+                .dstSubpass = 0,
+                .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+                .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+                    | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+            },
+            // the color target (or resolve) on to presentation or the readback copy
+            {
+                .srcSubpass = 0,
+                .dstSubpass = VK_SUBPASS_EXTERNAL,
+                .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                .dstStageMask = readBack ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                .dstAccessMask = readBack ? VK_ACCESS_TRANSFER_READ_BIT : VkAccessFlags(0)
+            }
+        };
+
+        VkRenderPassCreateInfo renderPassInfo = {
+            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+            .attachmentCount = static_cast<uint32_t>(attachments.size()),
+            .pAttachments = attachments.data(),
+            .subpassCount = 1,
+            .pSubpasses = &subpass,
+            .dependencyCount = std::extent_v<decltype(dependencies)>,
+            .pDependencies = dependencies
+        };
+
+        VkRenderPass renderPass;
+        if(vkCreateRenderPass(device_, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create render pass");
+
+        renderPasses_.emplace(_desc, renderPass);
+        return renderPass;
+    }
+
+    VkPipelineLayout layout(const PipelineLayoutDesc & _desc) {
+        if(auto it = layouts_.find(_desc); it != layouts_.end()) {
+            ++stats_.layouts.hits;
+            return it->second;
+        }
+        ++stats_.layouts.misses;
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+            .setLayoutCount = static_cast<uint32_t>(_desc.setLayouts.size()),
+            .pSetLayouts = _desc.setLayouts.data(),
+            .pushConstantRangeCount = static_cast<uint32_t>(_desc.pushConstantRanges.size()),
+            .pPushConstantRanges = _desc.pushConstantRanges.data()
+        };
+
+        VkPipelineLayout layout;
+        if(vkCreatePipelineLayout(device_, &pipelineLayoutInfo, nullptr, &layout) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create pipeline layout");
+
+        layouts_.emplace(_desc, layout);
+        return layout;
+    }
+
+    // VK_NULL_HANDLE while the pipeline is compiling or when it failed, draws using it are skipped
+    VkPipeline pipeline(const GraphicsPipelineDesc & _desc) {
+        if(auto it = pipelines_.find(_desc); it != pipelines_.end()) {
+            ++stats_.pipelines.hits;
+            return it->second.pipeline;
+        }
+        ++stats_.pipelines.misses;
+
+        auto [it, inserted] = pipelines_.emplace(_desc, PipelineEntry {});
+        compiling_[compiler_->submit(_desc)] = &it->second;
+
+        return VK_NULL_HANDLE;
+    }
+
+    // installs the pipelines the compiler finished and returns their results, never blocks.
+    // a failed compile leaves its entry empty, the caller reports the result's error
+    std::vector<PipelineCompiler::Result> update() {
+        auto results = compiler_->drain();
+
+        for(const auto & result : results) {
+            // unordered_map nodes stay put, the entry pointer is still valid
+            auto it = compiling_.find(result.ticket);
+            it->second->pipeline = result.pipeline;
+            compiling_.erase(it);
+        }
+
+        return results;
+    }
+
+    const Stats & stats() const noexcept {
+        return stats_;
+    }
+
+    void logStats(std::ostream & _out) const {
+        auto line = [&](const char * _name, size_t _cnt, const Counters & _counters) {
+            _out << "  " << _name << ": " << _cnt << " (" << _counters.hits << " hits, " << _counters.misses << " misses)\n";
+        };
+
+        _out << "Pipeline state cache:\n";
+        line("render passes", renderPasses_.size(), stats_.renderPasses);
+        line("pipeline layouts", layouts_.size(), stats_.layouts);
+        line("pipelines", pipelines_.size(), stats_.pipelines);
+    }
+
+private:
+    struct PipelineEntry {
+        VkPipeline pipeline = VK_NULL_HANDLE;
+    };
+
+    VkDevice device_ = VK_NULL_HANDLE;
+    PipelineCompiler * compiler_ = nullptr;
+
+    std::unordered_map<RenderPassDesc, VkRenderPass, StateHash> renderPasses_;
+    std::unordered_map<PipelineLayoutDesc, VkPipelineLayout, StateHash> layouts_;
+    std::unordered_map<GraphicsPipelineDesc, PipelineEntry, StateHash> pipelines_;
+    // compile ticket -> entry waiting for it
+    std::unordered_map<uint64_t, PipelineEntry *> compiling_;
+
+    Stats stats_;
+};
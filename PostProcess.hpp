@@ -0,0 +1,641 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "MemoryAllocator.hpp"
+
+// Tonemapping and a separable blur of the rendered frame in compute shaders, blitted into the presented image.
+// The frame renders into an HDR scene image per frame slot instead of the swapchain image.
+// Async: frame N's passes run on the compute queue while the graphics queue renders frame N+1, whose submit
+// blits them, so presentation trails rendering by a frame. Otherwise (no separate compute family, one frame in flight,
+// or forced) the passes and the blit are recorded into the frame's own command buffer.
+class PostProcess {
+public:
+    static constexpr VkFormat SCENE_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+    static constexpr VkFormat OUTPUT_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+    // of the scene image once the render pass is done, cmdRecord() takes it from there
+    static constexpr VkImageLayout SCENE_FINAL_LAYOUT = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    // an extra wait of the frame's graphics submit, semaphore VK_NULL_HANDLE: none
+    struct Wait {
+        VkSemaphore semaphore = VK_NULL_HANDLE;
+        uint64_t value = 0;
+        VkPipelineStageFlags stage = 0;
+    };
+
+    struct Stats {
+        uint64_t asyncFrames = 0;
+        uint64_t inlineFrames = 0; // on the graphics queue
+    };
+
+    // _graphicsTimeline: signaled with the frame number by every graphics submit
+    void init(VkDevice _device, MemoryAllocator & _allocator, VkPipelineCache _cache,
+        std::span<const uint32_t> _tonemapCode, std::span<const uint32_t> _blurCode,
+        uint32_t _graphicsFamily, uint32_t _computeFamily, VkQueue _computeQueue, VkSemaphore _graphicsTimeline,
+        uint32_t _slotCnt, VkExtent2D _extent, uint32_t _blurRadius) {
+        device_ = _device;
+        allocator_ = &_allocator;
+        graphicsFamily_ = _graphicsFamily;
+        computeFamily_ = _computeFamily;
+        computeQueue_ = _computeQueue;
+        graphicsTimeline_ = _graphicsTimeline;
+        blurRadius_ = _blurRadius;
+
+        // with a single slot the next frame would render into the scene image the compute queue still reads
+        asyncSupported_ = computeFamily_ != graphicsFamily_ && _slotCnt >= 2;
+        async_ = asyncSupported_;
+
+        createPipelines(_cache, _tonemapCode, _blurCode);
+
+        VkSemaphoreTypeCreateInfo timelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0
+        };
+
+        VkSemaphoreCreateInfo semaphoreInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &timelineInfo
+        };
+
+        // signaled with the submit number by every compute submit
+        if(vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &computeTimeline_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create post-process timeline semaphore");
+
+        slots_.resize(_slotCnt);
+        if(asyncSupported_) {
+            VkCommandPoolCreateInfo poolInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                .queueFamilyIndex = computeFamily_
+            };
+
+            for(auto & slot : slots_) {
+                if(vkCreateCommandPool(device_, &poolInfo, nullptr, &slot.pool) != VK_SUCCESS)
+                    throw std::runtime_error("Failed to create post-process command pool");
+
+                VkCommandBufferAllocateInfo allocInfo = {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                    .commandPool = slot.pool,
+                    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                    .commandBufferCount = 1
+                };
+
+                if(vkAllocateCommandBuffers(device_, &allocInfo, &slot.cmdBuf) != VK_SUCCESS)
+                    throw std::runtime_error("Failed to allocate post-process command buffer");
+            }
+        }
+
+        current_ = createTargets(_extent);
+    }
+
+    // the device must be idle
+    void destroy() noexcept {
+        while(!retired_.empty()) {
+            destroyTargets(retired_.front());
+            retired_.pop_front();
+        }
+        destroyTargets(current_);
+
+        for(auto & slot : slots_) {
+            if(slot.pool != VK_NULL_HANDLE)
+                vkDestroyCommandPool(device_, slot.pool, nullptr);
+        }
+        slots_.clear();
+
+        vkDestroySemaphore(device_, computeTimeline_, nullptr);
+        vkDestroyPipeline(device_, tonemapPipeline_, nullptr);
+        vkDestroyPipeline(device_, blurPipeline_, nullptr);
+        vkDestroyPipelineLayout(device_, pipelineLayout_, nullptr);
+        vkDestroyDescriptorSetLayout(device_, setLayout_, nullptr);
+    }
+
+    bool asyncSupported() const noexcept {
+        return asyncSupported_;
+    }
+
+    bool async() const noexcept {
+        return async_;
+    }
+
+    // the device must be idle
+    void setAsync(bool _async) noexcept {
+        async_ = _async && asyncSupported_;
+        pending_.reset();
+    }
+
+    // the render pass' resolve (or only) color attachment of the slot's frame
+    VkImageView sceneView(uint32_t _slot) const noexcept {
+        return current_.slots[_slot].scene.view;
+    }
+
+    // the images are sized like the swapchain; the old ones go once _lastFrame and its compute submit completed
+    void resize(VkExtent2D _extent, uint64_t _lastFrame) {
+        current_.lastFrame = _lastFrame;
+        current_.lastComputeValue = computeSubmitCnt_;
+        retired_.push_back(std::move(current_));
+
+        current_ = createTargets(_extent);
+
+        // its output has the old size, the next frame runs inline
+        pending_.reset();
+    }
+
+    void releaseRetired() {
+        if(retired_.empty())
+            return;
+
+        uint64_t graphicsCompleted, computeCompleted;
+        vkGetSemaphoreCounterValue(device_, graphicsTimeline_, &graphicsCompleted);
+        vkGetSemaphoreCounterValue(device_, computeTimeline_, &computeCompleted);
+
+        while(!retired_.empty() && graphicsCompleted >= retired_.front().lastFrame
+            && computeCompleted >= retired_.front().lastComputeValue) {
+            destroyTargets(retired_.front());
+            retired_.pop_front();
+        }
+    }
+
+    VkSemaphore timeline() const noexcept {
+        return computeTimeline_;
+    }
+
+    // blocks until the compute submit that last read the slot's scene image completed, returns the time blocked.
+    // before rendering into it again
+    double waitSlot(uint32_t _slot) const {
+        uint64_t value = slots_[_slot].computeValue;
+        uint64_t completed;
+        vkGetSemaphoreCounterValue(device_, computeTimeline_, &completed);
+        if(completed >= value)
+            return 0.0;
+
+        auto start = std::chrono::steady_clock::now();
+
+        VkSemaphoreWaitInfo waitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .semaphoreCount = 1,
+            .pSemaphores = &computeTimeline_,
+            .pValues = &value
+        };
+
+        if(vkWaitSemaphores(device_, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+            throw std::runtime_error("Failed to wait for post-process submit");
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count();
+    }
+
+    // records what the frame's command buffer does after the render pass: blits a post-processed image into _dstImage,
+    // leaving it in _dstLayout. Inline, the slot's own passes run first, async the previous frame's output is blitted.
+    // the slot's previous compute submit must have completed, see waitSlot(). The frame's graphics submit
+    // has to wait on the returned Wait and its swapchain image at VK_PIPELINE_STAGE_TRANSFER_BIT
+    Wait cmdRecord(VkCommandBuffer _cmdBuf, uint32_t _slot, VkImage _dstImage, VkImageLayout _dstLayout) {
+        const auto & targets = current_.slots[_slot];
+        bool inlinePasses = !async_ || !pending_;
+
+        // the compute queue waits for the whole graphics submit, which covers the memory side
+        imageBarrier(_cmdBuf, targets.scene.image, SCENE_FINAL_LAYOUT, VK_IMAGE_LAYOUT_GENERAL,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            inlinePasses ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            inlinePasses ? VK_ACCESS_SHADER_READ_BIT : 0);
+
+        Wait wait;
+        const SlotTargets * source = &targets;
+
+        if(inlinePasses) {
+            cmdPasses(_cmdBuf, targets);
+
+            imageBarrier(_cmdBuf, targets.ping.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+        } else {
+            // written by the compute queue, or inline by an earlier graphics submit
+            source = &current_.slots[pending_->slot];
+            if(pending_->computeValue != 0)
+                wait = { .semaphore = computeTimeline_, .value = pending_->computeValue, .stage = VK_PIPELINE_STAGE_TRANSFER_BIT };
+        }
+
+        // the frame's swapchain wait is at the transfer stage, chained by the barrier's source stage
+        imageBarrier(_cmdBuf, _dstImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+        VkExtent2D extent = current_.extent;
+        VkImageBlit region = {
+            .srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+            .srcOffsets = { { 0, 0, 0 }, { int32_t(extent.width), int32_t(extent.height), 1 } },
+            .dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+            .dstOffsets = { { 0, 0, 0 }, { int32_t(extent.width), int32_t(extent.height), 1 } }
+        };
+        // converts to the swapchain format, sRGB encoding included
+        vkCmdBlitImage(_cmdBuf, source->ping.image, VK_IMAGE_LAYOUT_GENERAL, _dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1, &region, VK_FILTER_NEAREST);
+
+        // like the render pass did before, frame capture and readback copy from it next
+        imageBarrier(_cmdBuf, _dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, _dstLayout,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+
+        recorded_ = Recorded { .slot = _slot, .inlinePasses = inlinePasses };
+        return wait;
+    }
+
+    // the command buffer of the last cmdRecord() was submitted, signaling _frameValue on the graphics timeline.
+    // async, this submits the frame's passes to the compute queue
+    void submitted(uint64_t _frameValue) {
+        if(!recorded_)
+            return;
+
+        auto [slotIndex, inlinePasses] = *recorded_;
+        recorded_.reset();
+
+        if(inlinePasses) {
+            ++stats_.inlineFrames;
+            // the next async frame blits this output, the graphics queue already ordered it
+            if(async_)
+                pending_ = Pending { .slot = slotIndex, .computeValue = 0 };
+            return;
+        }
+
+        Slot & slot = slots_[slotIndex];
+        vkResetCommandPool(device_, slot.pool, 0);
+
+        VkCommandBufferBeginInfo beginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+        };
+
+        if(vkBeginCommandBuffer(slot.cmdBuf, &beginInfo) != VK_SUCCESS)
+            throw std::runtime_error("Failed to begin post-process command buffer");
+
+        cmdPasses(slot.cmdBuf, current_.slots[slotIndex]);
+
+        if(vkEndCommandBuffer(slot.cmdBuf) != VK_SUCCESS)
+            throw std::runtime_error("Failed to end post-process command buffer");
+
+        uint64_t value = computeSubmitCnt_ + 1;
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+        VkTimelineSemaphoreSubmitInfo timelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .waitSemaphoreValueCount = 1,
+            .pWaitSemaphoreValues = &_frameValue,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &value
+        };
+
+        VkSubmitInfo submitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timelineInfo,
+            .waitSemaphoreCount = 1,
+            .pWaitSemaphores = &graphicsTimeline_,
+            .pWaitDstStageMask = &waitStage,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &slot.cmdBuf,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &computeTimeline_
+        };
+
+        if(vkQueueSubmit(computeQueue_, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+            throw std::runtime_error("Failed to submit post-process command buffer");
+
+        computeSubmitCnt_ = value;
+        slot.computeValue = value;
+        pending_ = Pending { .slot = slotIndex, .computeValue = value };
+        ++stats_.asyncFrames;
+    }
+
+    void logStats(std::ostream & _out) const {
+        _out << "Post-process: " << stats_.asyncFrames << " frames on the compute queue, "
+            << stats_.inlineFrames << " on the graphics queue\n";
+    }
+
+private:
+    static constexpr uint32_t GROUP_SIZE = 8;
+
+    // shared by both shaders
+    struct PushConstants {
+        int32_t direction[2];
+        int32_t radius;
+        float exposure;
+    };
+
+    struct Image {
+        VkImage image = VK_NULL_HANDLE;
+        MemoryAllocator::Allocation memory;
+        VkImageView view = VK_NULL_HANDLE;
+    };
+
+    // scene -> tonemap -> ping -> horizontal blur -> pong -> vertical blur -> ping
+    struct SlotTargets {
+        Image scene, ping, pong;
+        VkDescriptorSet tonemapSet = VK_NULL_HANDLE, blurXSet = VK_NULL_HANDLE, blurYSet = VK_NULL_HANDLE;
+    };
+
+    // a generation of images, replaced on resize
+    struct TargetSet {
+        std::vector<SlotTargets> slots;
+        VkDescriptorPool pool = VK_NULL_HANDLE;
+        VkExtent2D extent = {};
+        uint64_t lastFrame = 0, lastComputeValue = 0; // retired: the last submits using it
+    };
+
+    struct Slot {
+        VkCommandPool pool = VK_NULL_HANDLE; // compute family
+        VkCommandBuffer cmdBuf = VK_NULL_HANDLE;
+        uint64_t computeValue = 0;
+    };
+
+    struct Pending {
+        uint32_t slot;
+        uint64_t computeValue; // 0: written on the graphics queue
+    };
+
+    struct Recorded {
+        uint32_t slot;
+        bool inlinePasses;
+    };
+
+    VkDevice device_ = VK_NULL_HANDLE;
+    MemoryAllocator * allocator_ = nullptr;
+    uint32_t graphicsFamily_ = 0, computeFamily_ = 0;
+    VkQueue computeQueue_ = VK_NULL_HANDLE;
+    VkSemaphore graphicsTimeline_ = VK_NULL_HANDLE;
+    uint32_t blurRadius_ = 0;
+
+    bool asyncSupported_ = false, async_ = false;
+
+    VkDescriptorSetLayout setLayout_ = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout_ = VK_NULL_HANDLE;
+    VkPipeline tonemapPipeline_ = VK_NULL_HANDLE, blurPipeline_ = VK_NULL_HANDLE;
+
+    VkSemaphore computeTimeline_ = VK_NULL_HANDLE;
+    uint64_t computeSubmitCnt_ = 0;
+
+    std::vector<Slot> slots_;
+    TargetSet current_;
+    std::deque<TargetSet> retired_;
+
+    // the output the next async frame blits
+    std::optional<Pending> pending_;
+    std::optional<Recorded> recorded_;
+
+    Stats stats_;
+
+    void createPipelines(VkPipelineCache _cache, std::span<const uint32_t> _tonemapCode, std::span<const uint32_t> _blurCode) {
+        // binding 0: source, binding 1: destination
+        VkDescriptorSetLayoutBinding bindings[2];
+        for(uint32_t i = 0; i< 2; ++i) {
+            bindings[i] = {
+                .binding = i,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+            };
+        }
+
+        VkDescriptorSetLayoutCreateInfo setLayoutInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .bindingCount = 2,
+            .pBindings = bindings
+        };
+
+        if(vkCreateDescriptorSetLayout(device_, &setLayoutInfo, nullptr, &setLayout_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create post-process descriptor set layout");
+
+        VkPushConstantRange pushRange = {
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .offset = 0,
+            .size = sizeof(PushConstants)
+        };
+
+        VkPipelineLayoutCreateInfo layoutInfo = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+            .setLayoutCount = 1,
+            .pSetLayouts = &setLayout_,
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &pushRange
+        };
+
+        if(vkCreatePipelineLayout(device_, &layoutInfo, nullptr, &pipelineLayout_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create post-process pipeline layout");
+
+        tonemapPipeline_ = createPipeline(_cache, _tonemapCode);
+        blurPipeline_ = createPipeline(_cache, _blurCode);
+    }
+
+    VkPipeline createPipeline(VkPipelineCache _cache, std::span<const uint32_t> _code) {
+        VkShaderModuleCreateInfo moduleInfo = {
+            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+            .codeSize = _code.size_bytes(),
+            .pCode = _code.data()
+        };
+
+        VkShaderModule module;
+        if(vkCreateShaderModule(device_, &moduleInfo, nullptr, &module) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create post-process shader module");
+
+        VkComputePipelineCreateInfo pipelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = module,
+                .pName = "main"
+            },
+            .layout = pipelineLayout_
+        };
+
+        VkPipeline pipeline;
+        auto res = vkCreateComputePipelines(device_, _cache, 1, &pipelineInfo, nullptr, &pipeline);
+        vkDestroyShaderModule(device_, module, nullptr);
+
+        if(res != VK_SUCCESS)
+            throw std::runtime_error("Failed to create post-process pipeline");
+
+        return pipeline;
+    }
+
+    TargetSet createTargets(VkExtent2D _extent) {
+        TargetSet targets;
+        targets.extent = _extent;
+        targets.slots.resize(slots_.size());
+
+        uint32_t setCnt = 3 * static_cast<uint32_t>(slots_.size());
+        VkDescriptorPoolSize poolSize = {
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .descriptorCount = 2 * setCnt
+        };
+
+        VkDescriptorPoolCreateInfo poolInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+            .maxSets = setCnt,
+            .poolSizeCount = 1,
+            .pPoolSizes = &poolSize
+        };
+
+        if(vkCreateDescriptorPool(device_, &poolInfo, nullptr, &targets.pool) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create post-process descriptor pool");
+
+        for(auto & slot : targets.slots) {
+            slot.scene = createImage(SCENE_FORMAT, _extent, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT);
+            slot.ping = createImage(OUTPUT_FORMAT, _extent, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+            slot.pong = createImage(OUTPUT_FORMAT, _extent, VK_IMAGE_USAGE_STORAGE_BIT);
+
+            slot.tonemapSet = createSet(targets.pool, slot.scene, slot.ping);
+            slot.blurXSet = createSet(targets.pool, slot.ping, slot.pong);
+            slot.blurYSet = createSet(targets.pool, slot.pong, slot.ping);
+        }
+
+        return targets;
+    }
+
+    void destroyTargets(TargetSet & _targets) noexcept {
+        for(auto & slot : _targets.slots) {
+            for(auto image : { &slot.scene, &slot.ping, &slot.pong }) {
+                if(image->image == VK_NULL_HANDLE)
+                    continue;
+
+                vkDestroyImageView(device_, image->view, nullptr);
+                allocator_->destroyImage(image->image, image->memory);
+            }
+        }
+
+        if(_targets.pool != VK_NULL_HANDLE)
+            vkDestroyDescriptorPool(device_, _targets.pool, nullptr);
+        _targets = {};
+    }
+
+    // shared by both queues when they're separate families, saves queue family ownership transfers every frame
+    Image createImage(VkFormat _format, VkExtent2D _extent, VkImageUsageFlags _usage) {
+        uint32_t families[] = { graphicsFamily_, computeFamily_ };
+
+        VkImageCreateInfo imageInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = _format,
+            .extent = { _extent.width, _extent.height, 1 },
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = _usage,
+            .sharingMode = asyncSupported_ ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = asyncSupported_ ? 2U : 0U,
+            .pQueueFamilyIndices = families,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+        };
+
+        Image image;
+        std::tie(image.image, image.memory) = allocator_->createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        VkImageViewCreateInfo viewInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = image.image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = _format,
+            .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+        };
+
+        if(vkCreateImageView(device_, &viewInfo, nullptr, &image.view) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create post-process image view");
+
+        return image;
+    }
+
+    VkDescriptorSet createSet(VkDescriptorPool _pool, const Image & _src, const Image & _dst) {
+        VkDescriptorSetAllocateInfo allocInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = _pool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &setLayout_
+        };
+
+        VkDescriptorSet set;
+        if(vkAllocateDescriptorSets(device_, &allocInfo, &set) != VK_SUCCESS)
+            throw std::runtime_error("Failed to allocate post-process descriptor set");
+
+        VkDescriptorImageInfo imageInfos[] = {
+            { .sampler = VK_NULL_HANDLE, .imageView = _src.view, .imageLayout = VK_IMAGE_LAYOUT_GENERAL },
+            { .sampler = VK_NULL_HANDLE, .imageView = _dst.view, .imageLayout = VK_IMAGE_LAYOUT_GENERAL }
+        };
+
+        VkWriteDescriptorSet write = {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = set,
+            .dstBinding = 0,
+            .dstArrayElement = 0,
+            .descriptorCount = 2,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .pImageInfo = imageInfos
+        };
+
+        vkUpdateDescriptorSets(device_, 1, &write, 0, nullptr);
+        return set;
+    }
+
+    // the scene image must be in GENERAL with its writes visible to compute shaders
+    void cmdPasses(VkCommandBuffer _cmdBuf, const SlotTargets & _targets) {
+        // previous contents are overwritten, the last blit reading ping was ordered before by the frame pacing
+        for(auto image : { _targets.ping.image, _targets.pong.image }) {
+            imageBarrier(_cmdBuf, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+        }
+
+        VkExtent2D extent = current_.extent;
+        uint32_t groupCntX = (extent.width + GROUP_SIZE - 1) / GROUP_SIZE;
+        uint32_t groupCntY = (extent.height + GROUP_SIZE - 1) / GROUP_SIZE;
+
+        auto pass = [&](VkPipeline _pipeline, VkDescriptorSet _set, PushConstants _constants) {
+            vkCmdBindPipeline(_cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+            vkCmdBindDescriptorSets(_cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout_, 0, 1, &_set, 0, nullptr);
+            vkCmdPushConstants(_cmdBuf, pipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(_constants), &_constants);
+            vkCmdDispatch(_cmdBuf, groupCntX, groupCntY, 1);
+        };
+
+        // each pass reads what the one before wrote
+        auto passBarrier = [&] {
+            VkMemoryBarrier barrier = {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+            };
+            vkCmdPipelineBarrier(_cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                0, 1, &barrier, 0, nullptr, 0, nullptr);
+        };
+
+        int32_t radius = static_cast<int32_t>(blurRadius_);
+        pass(tonemapPipeline_, _targets.tonemapSet, { .direction = { 0, 0 }, .radius = 0, .exposure = 1.0F });
+        passBarrier();
+        pass(blurPipeline_, _targets.blurXSet, { .direction = { 1, 0 }, .radius = radius, .exposure = 1.0F });
+        passBarrier();
+        pass(blurPipeline_, _targets.blurYSet, { .direction = { 0, 1 }, .radius = radius, .exposure = 1.0F });
+    }
+
+    static void imageBarrier(VkCommandBuffer _cmdBuf, VkImage _image, VkImageLayout _oldLayout, VkImageLayout _newLayout,
+        VkPipelineStageFlags _srcStage, VkAccessFlags _srcAccess, VkPipelineStageFlags _dstStage, VkAccessFlags _dstAccess) noexcept {
+        VkImageMemoryBarrier barrier = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = _srcAccess,
+            .dstAccessMask = _dstAccess,
+            .oldLayout = _oldLayout,
+            .newLayout = _newLayout,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = _image,
+            .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+        };
+
+        vkCmdPipelineBarrier(_cmdBuf, _srcStage, _dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+// SPIR-V compiled from the GLSL sources at build time, see CMakeLists.txt.
+// Being uint32_t arrays they satisfy pCode's 4-byte alignment without a copy.
+
+inline constexpr uint32_t __baseVertShaderCode[] = {
+#include "09_shader_base.vert.spv.inc"
+};
+
+inline constexpr uint32_t __baseFragShaderCode[] = {
+#include "09_shader_base.frag.spv.inc"
+};
+
+inline constexpr uint32_t __cullCompShaderCode[] = {
+#include "10_cull.comp.spv.inc"
+};
+
+inline constexpr uint32_t __saxpyCompShaderCode[] = {
+#include "11_saxpy.comp.spv.inc"
+};
+
+inline constexpr uint32_t __tonemapCompShaderCode[] = {
+#include "12_tonemap.comp.spv.inc"
+};
+
+inline constexpr uint32_t __blurCompShaderCode[] = {
+#include "13_blur.comp.spv.inc"
+};
+
+struct EmbeddedShader {
+    std::string_view name; // GLSL source file name
+    std::span<const uint32_t> code;
+};
+
+inline constexpr EmbeddedShader __embeddedShaders[] = {
+    { "09_shader_base.vert", __baseVertShaderCode },
+    { "09_shader_base.frag", __baseFragShaderCode },
+    { "10_cull.comp", __cullCompShaderCode },
+    { "11_saxpy.comp", __saxpyCompShaderCode },
+    { "12_tonemap.comp", __tonemapCompShaderCode },
+    { "13_blur.comp", __blurCompShaderCode }
+};
+
+constexpr std::span<const uint32_t> findEmbeddedShader(std::string_view _name) noexcept {
+    for(const auto & shader : __embeddedShaders) {
+        if(shader.name == _name)
+            return shader.code;
+    }
+
+    return {};
+}
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "MemoryAllocator.hpp"
+
+// Streams data into device-local buffers through a persistently mapped staging ring.
+// Copies run on a transfer queue (a dedicated family when the device has one), one submit per frame slot.
+// Uploads larger than the free ring space are split over as many frames as needed, so nothing waits for space.
+class StagingUploader {
+public:
+    static constexpr VkDeviceSize DEFAULT_RING_SIZE = 16ULL << 20;
+
+    // what the graphics submit of the same frame has to wait on
+    struct Batch {
+        VkSemaphore semaphore = VK_NULL_HANDLE; // timeline
+        uint64_t value = 0;
+        VkPipelineStageFlags waitStage = 0;
+    };
+
+    void init(VkDevice _device, MemoryAllocator & _allocator, uint32_t _transferFamily, VkQueue _transferQueue,
+        uint32_t _graphicsFamily, uint32_t _slotCnt, VkDeviceSize _ringSize = DEFAULT_RING_SIZE) {
+        device_ = _device;
+        allocator_ = &_allocator;
+        transferFamily_ = _transferFamily;
+        transferQueue_ = _transferQueue;
+        graphicsFamily_ = _graphicsFamily;
+        ringSize_ = _ringSize / ALIGNMENT * ALIGNMENT;
+
+        std::tie(ring_, ringMemory_) = allocator_->createBuffer(ringSize_, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        VkCommandPoolCreateInfo poolInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+            .queueFamilyIndex = transferFamily_
+        };
+
+        VkSemaphoreTypeCreateInfo timelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0
+        };
+
+        VkSemaphoreCreateInfo semaphoreInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &timelineInfo
+        };
+
+        // signaled with the batch number by every transfer submit
+        if(vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &timeline_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create transfer timeline semaphore");
+
+        slots_.resize(_slotCnt);
+        for(auto & slot : slots_) {
+            if(vkCreateCommandPool(device_, &poolInfo, nullptr, &slot.pool) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create transfer command pool");
+
+            VkCommandBufferAllocateInfo allocInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = slot.pool,
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = 1
+            };
+
+            if(vkAllocateCommandBuffers(device_, &allocInfo, &slot.cmdBuf) != VK_SUCCESS)
+                throw std::runtime_error("Failed to allocate transfer command buffer");
+        }
+    }
+
+    // the device must be idle
+    void destroy() noexcept {
+        for(auto & slot : slots_)
+            vkDestroyCommandPool(device_, slot.pool, nullptr);
+        slots_.clear();
+
+        vkDestroySemaphore(device_, timeline_, nullptr);
+        timeline_ = VK_NULL_HANDLE;
+        pending_.clear();
+
+        if(ring_ != VK_NULL_HANDLE)
+            allocator_->destroyBuffer(ring_, ringMemory_);
+        ring_ = VK_NULL_HANDLE;
+    }
+
+    bool dedicatedQueue() const noexcept {
+        return transferFamily_ != graphicsFamily_;
+    }
+
+    // _dst must be an exclusive buffer with TRANSFER_DST usage, first used by graphics with _dstStage/_dstAccess.
+    // returns a ticket for isReady()
+    uint64_t enqueue(VkBuffer _dst, VkDeviceSize _dstOffset, std::vector<char> _data,
+        VkPipelineStageFlags _dstStage, VkAccessFlags _dstAccess) {
+        pending_.push_back({
+            .ticket = ++lastTicket_,
+            .dst = _dst,
+            .dstOffset = _dstOffset,
+            .data = std::move(_data),
+            .dstStage = _dstStage,
+            .dstAccess = _dstAccess
+        });
+
+        return lastTicket_;
+    }
+
+    // usable by graphics work submitted after the flush() that finished it
+    bool isReady(uint64_t _ticket) const noexcept {
+        return _ticket <= readyTicket_;
+    }
+
+    bool idle() const noexcept {
+        return pending_.empty();
+    }
+
+    // copies as much of the pending data as the ring has room for and submits it.
+    // the slot's previous graphics submission, which waited on its last batch, must have completed.
+    // the returned semaphore value has to be waited on by this frame's graphics submit, which also records cmdAcquire()
+    Batch flush(uint32_t _slot) {
+        auto & slot = slots_[_slot];
+
+        // the ring space of the slot's previous batch is free again
+        tail_ = std::max(tail_, slot.ringEnd);
+        slot.acquires.clear();
+        slot.dstStages = 0;
+
+        if(pending_.empty())
+            return {};
+
+        vkResetCommandPool(device_, slot.pool, 0);
+
+        VkCommandBufferBeginInfo beginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+        };
+
+        if(vkBeginCommandBuffer(slot.cmdBuf, &beginInfo) != VK_SUCCESS)
+            throw std::runtime_error("Failed to begin transfer command buffer");
+
+        std::vector<VkBufferMemoryBarrier> releases;
+        bool copied = false;
+
+        while(!pending_.empty()) {
+            auto & upload = pending_.front();
+
+            VkDeviceSize remaining = upload.data.size() - upload.uploaded;
+            auto [offset, size] = reserve(remaining);
+            if(size == 0)
+                break;
+
+            std::memcpy(static_cast<char *>(ringMemory_.mapped) + offset, upload.data.data() + upload.uploaded, size);
+            allocator_->flush(ringMemory_, offset, size);
+
+            VkBufferCopy region = {
+                .srcOffset = offset,
+                .dstOffset = upload.dstOffset + upload.uploaded,
+                .size = size
+            };
+            vkCmdCopyBuffer(slot.cmdBuf, ring_, upload.dst, 1, &region);
+
+            upload.uploaded += size;
+            copied = true;
+
+            if(upload.uploaded < upload.data.size())
+                continue;
+
+            // the semaphore alone orders the copy against graphics when both share a family
+            if(dedicatedQueue()) {
+                VkBufferMemoryBarrier barrier = {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                    .dstAccessMask = 0,
+                    .srcQueueFamilyIndex = transferFamily_,
+                    .dstQueueFamilyIndex = graphicsFamily_,
+                    .buffer = upload.dst,
+                    .offset = upload.dstOffset,
+                    .size = upload.data.size()
+                };
+                releases.push_back(barrier);
+
+                // the matching acquire on the graphics queue
+                barrier.srcAccessMask = 0;
+                barrier.dstAccessMask = upload.dstAccess;
+                slot.acquires.push_back(barrier);
+            }
+
+            slot.dstStages |= upload.dstStage;
+            readyTicket_ = upload.ticket;
+            pending_.pop_front();
+        }
+
+        if(!releases.empty()) {
+            vkCmdPipelineBarrier(slot.cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                0, 0, nullptr, releases.size(), releases.data(), 0, nullptr);
+        }
+
+        if(vkEndCommandBuffer(slot.cmdBuf) != VK_SUCCESS)
+            throw std::runtime_error("Failed to end transfer command buffer");
+
+        // ring full: try again next frame
+        if(!copied)
+            return {};
+
+        slot.ringEnd = head_;
+
+        uint64_t value = ++batchValue_;
+        VkTimelineSemaphoreSubmitInfo timelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &value
+        };
+
+        VkSubmitInfo submitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timelineInfo,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &slot.cmdBuf,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &timeline_
+        };
+
+        if(vkQueueSubmit(transferQueue_, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+            throw std::runtime_error("Failed to submit transfer command buffer");
+
+        // partial uploads still need the wait, the next batch reuses the ring space only after this frame
+        return { timeline_, value, slot.dstStages != 0 ? slot.dstStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT };
+    }
+
+    // ownership acquire for the uploads finished by the slot's last flush(), recorded outside of a render pass
+    void cmdAcquire(VkCommandBuffer _cmdBuf, uint32_t _slot) noexcept {
+        auto & slot = slots_[_slot];
+        if(slot.acquires.empty())
+            return;
+
+        // source stages match the semaphore wait, so the acquire is chained to it
+        vkCmdPipelineBarrier(_cmdBuf, slot.dstStages, slot.dstStages,
+            0, 0, nullptr, slot.acquires.size(), slot.acquires.data(), 0, nullptr);
+    }
+
+private:
+    static constexpr VkDeviceSize ALIGNMENT = 16;
+
+    struct Upload {
+        uint64_t ticket;
+        VkBuffer dst;
+        VkDeviceSize dstOffset;
+        std::vector<char> data;
+        VkPipelineStageFlags dstStage;
+        VkAccessFlags dstAccess;
+        VkDeviceSize uploaded = 0;
+    };
+
+    struct Slot {
+        VkCommandPool pool = VK_NULL_HANDLE;
+        VkCommandBuffer cmdBuf = VK_NULL_HANDLE;
+        // ring head after the slot's last batch
+        uint64_t ringEnd = 0;
+        std::vector<VkBufferMemoryBarrier> acquires;
+        VkPipelineStageFlags dstStages = 0;
+    };
+
+    VkDevice device_ = VK_NULL_HANDLE;
+    MemoryAllocator * allocator_ = nullptr;
+    uint32_t transferFamily_ = 0, graphicsFamily_ = 0;
+    VkQueue transferQueue_ = VK_NULL_HANDLE;
+    VkSemaphore timeline_ = VK_NULL_HANDLE;
+    uint64_t batchValue_ = 0;
+
+    VkBuffer ring_ = VK_NULL_HANDLE;
+    MemoryAllocator::Allocation ringMemory_;
+    VkDeviceSize ringSize_ = 0;
+    // monotonic byte counters, the ring offset is counter % ringSize_
+    uint64_t head_ = 0, tail_ = 0;
+
+    std::vector<Slot> slots_;
+    std::deque<Upload> pending_;
+    uint64_t lastTicket_ = 0, readyTicket_ = 0;
+
+    // contiguous space at the head of the ring, at most _maxSize, size 0 when the ring is full
+    std::pair<VkDeviceSize, VkDeviceSize> reserve(VkDeviceSize _maxSize) noexcept {
+        VkDeviceSize offset = head_ % ringSize_;
+        VkDeviceSize size = std::min({ _maxSize, ringSize_ - offset, ringSize_ - (head_ - tail_) });
+
+        // head_ stays aligned, the padding always fits as ring size and used space are multiples of ALIGNMENT
+        head_ += (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+        return { offset, size };
+    }
+};
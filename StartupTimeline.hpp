@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Wall-clock spans of the startup steps, recorded from any thread.
+// The table shows what overlapped, total vs. summed step time how much the overlap saved.
+class StartupTimeline {
+public:
+    struct Step {
+        std::string name;
+        uint32_t thread; // 0: the thread that called start(), the others in order of appearance
+        double startMs; // since start()
+        double durationMs;
+    };
+
+    void start() {
+        std::lock_guard lock(mutex_);
+        origin_ = std::chrono::steady_clock::now();
+        steps_.clear();
+        threads_.clear();
+        threads_[std::this_thread::get_id()] = 0;
+    }
+
+    // runs _fn, recording it as _name if it returns normally
+    template<typename Fn>
+    void time(std::string_view _name, Fn && _fn) {
+        auto begin = std::chrono::steady_clock::now();
+        _fn();
+        auto end = std::chrono::steady_clock::now();
+
+        std::lock_guard lock(mutex_);
+        auto [it, inserted] = threads_.try_emplace(std::this_thread::get_id(), uint32_t(threads_.size()));
+
+        steps_.push_back({
+            .name = std::string(_name),
+            .thread = it->second,
+            .startMs = std::chrono::duration<double, std::milli>(begin - origin_).count(),
+            .durationMs = std::chrono::duration<double, std::milli>(end - begin).count()
+        });
+    }
+
+    // end of the last step, the critical path when the steps cover all of startup
+    double totalMs() const {
+        std::lock_guard lock(mutex_);
+        double total = 0.0;
+        for(const auto & step : steps_)
+            total = std::max(total, step.startMs + step.durationMs);
+        return total;
+    }
+
+    double summedMs() const {
+        std::lock_guard lock(mutex_);
+        double summed = 0.0;
+        for(const auto & step : steps_)
+            summed += step.durationMs;
+        return summed;
+    }
+
+    void printTable(std::ostream & _out) const {
+        auto steps = sortedSteps();
+
+        size_t nameWidth = 4;
+        for(const auto & step : steps)
+            nameWidth = std::max(nameWidth, step.name.size());
+
+        char line[256];
+        std::snprintf(line, sizeof(line), "  %-*s %10s %10s %7s\n", int(nameWidth), "step", "start ms", "ms", "thread");
+        _out << "Startup:\n" << line;
+
+        for(const auto & step : steps) {
+            std::snprintf(line, sizeof(line), "  %-*s %10.2f %10.2f %7u\n",
+                int(nameWidth), step.name.c_str(), step.startMs, step.durationMs, step.thread);
+            _out << line;
+        }
+
+        std::snprintf(line, sizeof(line), "  total %.2f ms, %.2f ms summed over steps\n", totalMs(), summedMs());
+        _out << line;
+    }
+
+    // step names are plain identifiers, nothing gets escaped
+    bool writeJson(const std::string & _path) const {
+        std::ofstream file(_path, std::ios::trunc);
+        if(!file.is_open())
+            return false;
+
+        file << "{\n  \"totalMs\": " << totalMs() << ",\n  \"summedMs\": " << summedMs() << ",\n  \"steps\": [";
+
+        auto steps = sortedSteps();
+        for(size_t i = 0; i< steps.size(); ++i) {
+            const auto & step = steps[i];
+            file << (i == 0 ? "\n" : ",\n") << "    { \"name\": \"" << step.name << "\", \"thread\": " << step.thread
+                << ", \"startMs\": " << step.startMs << ", \"durationMs\": " << step.durationMs << " }";
+        }
+
+        file << "\n  ]\n}\n";
+        return bool(file);
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::chrono::steady_clock::time_point origin_ = std::chrono::steady_clock::now();
+    std::vector<Step> steps_;
+    std::map<std::thread::id, uint32_t> threads_;
+
+    std::vector<Step> sortedSteps() const {
+        std::lock_guard lock(mutex_);
+        auto steps = steps_;
+        std::stable_sort(steps.begin(), steps.end(), [](const Step & _a, const Step & _b) { return _a.startMs < _b.startMs; });
+        return steps;
+    }
+};
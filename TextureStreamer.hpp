@@ -0,0 +1,509 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "MappedFile.hpp"
+#include "MemoryAllocator.hpp"
+
+// Streams textures from KTX2 files into sampled images without blocking the render thread.
+// A loader thread maps each file and copies it, a row range at a time, straight from the mapping into a
+// host-visible staging ring. The render thread records the copies of at most a per-frame byte budget into the
+// frame's command buffer, finest level last, and blits the levels the file doesn't carry.
+// view() grows from the coarsest level down to the base level as they become resident.
+class TextureStreamer {
+public:
+    static constexpr VkDeviceSize DEFAULT_RING_SIZE = 64ULL << 20;
+    static constexpr VkDeviceSize DEFAULT_FRAME_BUDGET = 8ULL << 20;
+
+    using Handle = uint32_t;
+
+    struct Stats {
+        uint32_t loaded = 0; // every level resident
+        uint32_t failed = 0; // the file couldn't be loaded, view() keeps what was resident by then
+        uint64_t bytes = 0;
+        uint32_t frames = 0; // that streamed anything
+        uint64_t maxFrameBytes = 0;
+    };
+
+    // _slotCnt: frames in flight, a slot's ring space and retired views are released once it comes round again
+    void init(VkDevice _device, VkPhysicalDevice _physicalDevice, MemoryAllocator & _allocator, uint32_t _slotCnt,
+        VkDeviceSize _frameBudget = DEFAULT_FRAME_BUDGET, VkDeviceSize _ringSize = DEFAULT_RING_SIZE) {
+        device_ = _device;
+        physicalDevice_ = _physicalDevice;
+        allocator_ = &_allocator;
+        ringSize_ = _ringSize / ALIGNMENT * ALIGNMENT;
+        // a chunk has to fit the ring with room for the frames in flight to hold theirs
+        chunkSize_ = std::max(std::min(_frameBudget, ringSize_ / (_slotCnt + 1)) / ALIGNMENT * ALIGNMENT, ALIGNMENT);
+        frameBudget_ = std::max(_frameBudget, chunkSize_);
+
+        std::tie(ring_, ringMemory_) = allocator_->createBuffer(ringSize_, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        slots_.resize(_slotCnt);
+        quit_ = false;
+        loader_ = std::thread([this] { loaderLoop(); });
+    }
+
+    // the device must be idle
+    void destroy() noexcept {
+        if(loader_.joinable()) {
+            {
+                std::lock_guard lock(mutex_);
+                quit_ = true;
+                requests_.clear();
+            }
+            requestCv_.notify_all();
+            spaceCv_.notify_all();
+            loader_.join();
+        }
+
+        for(auto & slot : slots_) {
+            for(auto view : slot.retiredViews)
+                vkDestroyImageView(device_, view, nullptr);
+        }
+        slots_.clear();
+
+        for(auto & texture : textures_) {
+            if(texture.view != VK_NULL_HANDLE)
+                vkDestroyImageView(device_, texture.view, nullptr);
+            if(texture.image != VK_NULL_HANDLE)
+                allocator_->destroyImage(texture.image, texture.memory);
+        }
+        textures_.clear();
+        ready_.clear();
+
+        if(ring_ != VK_NULL_HANDLE)
+            allocator_->destroyBuffer(ring_, ringMemory_);
+        ring_ = VK_NULL_HANDLE;
+    }
+
+    // queues the file, its levels get resident over the next frames
+    Handle load(std::string _path) {
+        Handle handle;
+        {
+            std::lock_guard lock(mutex_);
+            handle = Handle(textures_.size());
+            requests_.push_back({ handle, &textures_.emplace_back(), std::move(_path) });
+        }
+        requestCv_.notify_one();
+
+        return handle;
+    }
+
+    // VK_NULL_HANDLE until the coarsest level is resident; changes as finer levels arrive, look it up every frame
+    VkImageView view(Handle _texture) const noexcept {
+        return textures_[_texture].view;
+    }
+
+    bool failed(Handle _texture) const noexcept {
+        return textures_[_texture].failed;
+    }
+
+    bool complete(Handle _texture) const noexcept {
+        const auto & texture = textures_[_texture];
+        return texture.view != VK_NULL_HANDLE && texture.residentLevel == 0;
+    }
+
+    // records this frame's share of the staged uploads, outside of a render pass.
+    // the slot's previous submission must have completed
+    void cmdStream(VkCommandBuffer _cmdBuf, uint32_t _slot) {
+        auto & slot = slots_[_slot];
+
+        for(auto view : slot.retiredViews)
+            vkDestroyImageView(device_, view, nullptr);
+        slot.retiredViews.clear();
+
+        std::vector<Chunk> chunks;
+        {
+            std::lock_guard lock(mutex_);
+
+            // the ring space of the slot's previous frame is free again
+            if(slot.ringEnd > tail_) {
+                tail_ = slot.ringEnd;
+                spaceCv_.notify_one();
+            }
+
+            VkDeviceSize bytes = 0;
+            while(!ready_.empty() && (chunks.empty() || bytes + ready_.front().size <= frameBudget_)) {
+                bytes += ready_.front().size;
+                chunks.push_back(std::move(ready_.front()));
+                ready_.pop_front();
+            }
+        }
+
+        if(chunks.empty())
+            return;
+
+        uint64_t bytes = 0;
+        for(const auto & chunk : chunks) {
+            // the texture stays on whatever the caller shows without it, the rest of the batch goes on
+            if(!chunk.error.empty()) {
+                std::cerr << chunk.error << "\n";
+                textures_[chunk.texture].failed = true;
+                ++stats_.failed;
+                continue;
+            }
+
+            recordChunk(_cmdBuf, slot, chunk);
+            bytes += chunk.size;
+            slot.ringEnd = chunk.ringEnd;
+        }
+
+        ++stats_.frames;
+        stats_.bytes += bytes;
+        stats_.maxFrameBytes = std::max(stats_.maxFrameBytes, bytes);
+    }
+
+    const Stats & stats() const noexcept {
+        return stats_;
+    }
+
+    void logStats(std::ostream & _out) const {
+        constexpr double MiB = 1024.0 * 1024.0;
+        _out << "Textures: " << stats_.loaded << " of " << textures_.size() << " loaded, " << stats_.failed << " failed, " << stats_.bytes / MiB
+            << " MiB streamed over " << stats_.frames << " frames, at most " << stats_.maxFrameBytes / MiB << " MiB in a frame\n";
+    }
+
+private:
+    static constexpr VkDeviceSize ALIGNMENT = 16; // a multiple of every supported texel size
+
+    struct Texture {
+        // written by the loader before its first chunk is queued
+        VkImage image = VK_NULL_HANDLE;
+        MemoryAllocator::Allocation memory;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkExtent2D extent = {};
+        uint32_t levelCnt = 0, storedLevelCnt = 0;
+
+        // render thread only
+        VkImageView view = VK_NULL_HANDLE;
+        uint32_t residentLevel = UINT32_MAX; // finest level usable for sampling
+        bool started = false;
+        bool failed = false;
+    };
+
+    struct Request {
+        Handle handle;
+        Texture * texture; // the loader never touches textures_ itself, load() may grow it meanwhile
+        std::string path;
+    };
+
+    // rows [firstRow, firstRow + rowCnt) of a level, staged at ringOffset
+    struct Chunk {
+        Handle texture = 0;
+        uint32_t level = 0;
+        uint32_t firstRow = 0, rowCnt = 0;
+        VkDeviceSize ringOffset = 0, size = 0;
+        uint64_t ringEnd = 0; // head_ after the chunk
+        bool lastOfLevel = false;
+        std::string error; // the file couldn't be loaded, nothing else is set
+    };
+
+    struct Slot {
+        uint64_t ringEnd = 0; // of the last chunk recorded into the slot's frame
+        std::vector<VkImageView> retiredViews;
+    };
+
+    VkDevice device_ = VK_NULL_HANDLE;
+    VkPhysicalDevice physicalDevice_ = VK_NULL_HANDLE;
+    MemoryAllocator * allocator_ = nullptr;
+
+    VkBuffer ring_ = VK_NULL_HANDLE;
+    MemoryAllocator::Allocation ringMemory_;
+    VkDeviceSize ringSize_ = 0, chunkSize_ = 0, frameBudget_ = 0;
+
+    std::vector<Slot> slots_;
+    Stats stats_;
+
+    std::thread loader_;
+    std::mutex mutex_;
+    std::condition_variable requestCv_, spaceCv_;
+    // deque: the loader fills in textures while the render thread reads others
+    std::deque<Texture> textures_;
+    std::deque<Request> requests_;
+    std::deque<Chunk> ready_;
+    // monotonic byte counters, the ring offset is counter % ringSize_
+    uint64_t head_ = 0, tail_ = 0;
+    bool quit_ = false;
+
+    void loaderLoop() {
+        while(true) {
+            Request request;
+            {
+                std::unique_lock lock(mutex_);
+                requestCv_.wait(lock, [this] { return quit_ || !requests_.empty(); });
+
+                if(quit_)
+                    return;
+
+                request = std::move(requests_.front());
+                requests_.pop_front();
+            }
+
+            try {
+                stream(request);
+            } catch(const std::exception & e) {
+                std::lock_guard lock(mutex_);
+                ready_.push_back({ .texture = request.handle, .error = e.what() });
+            }
+        }
+    }
+
+    static uint32_t texelSize(VkFormat _format) noexcept {
+        switch(_format) {
+        case VK_FORMAT_R8_UNORM: return 1;
+        case VK_FORMAT_R8G8_UNORM: return 2;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB: return 4;
+        case VK_FORMAT_R16G16B16A16_SFLOAT: return 8;
+        case VK_FORMAT_R32G32B32A32_SFLOAT: return 16;
+        default: return 0;
+        }
+    }
+
+    // loader thread: creates the image and stages the file's levels, coarsest first
+    void stream(const Request & _request) {
+        MappedFile file(_request.path);
+
+        // KTX2: identifier, 9 uint32 header fields, the index, then a (byteOffset, byteLength, uncompressedByteLength)
+        // uint64 triple per level, level 0 being the base level
+        static constexpr unsigned char IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+        constexpr size_t HEADER_SIZE = 12 + 9 * 4, LEVEL_INDEX_OFFSET = HEADER_SIZE + 4 * 4 + 2 * 8;
+
+        auto fail = [&](const std::string & _what) {
+            return std::runtime_error("Failed to load texture(\"" + _request.path + "\"): " + _what);
+        };
+
+        if(file.size() < LEVEL_INDEX_OFFSET || std::memcmp(file.data(), IDENTIFIER, sizeof(IDENTIFIER)) != 0)
+            throw fail("not a KTX2 file");
+
+        uint32_t header[9];
+        std::memcpy(header, file.data() + 12, sizeof(header));
+        auto [vkFormat, typeSize, width, height, depth, layerCnt, faceCnt, levelCnt, supercompression] = header;
+
+        VkFormat format = VkFormat(vkFormat);
+        uint32_t texelSz = texelSize(format);
+        if(texelSz == 0)
+            throw fail("unsupported format " + std::to_string(vkFormat));
+        if(width == 0 || height == 0 || depth > 1 || layerCnt > 1 || faceCnt != 1 || supercompression != 0)
+            throw fail("only uncompressed 2D textures are supported");
+
+        uint32_t storedLevelCnt = std::max(levelCnt, 1U);
+        if(file.size() < LEVEL_INDEX_OFFSET + storedLevelCnt * 3 * sizeof(uint64_t))
+            throw fail("truncated level index");
+
+        uint32_t fullLevelCnt = 1;
+        for(auto sz = std::max(width, height); sz > 1; sz >>= 1)
+            ++fullLevelCnt;
+        storedLevelCnt = std::min(storedLevelCnt, fullLevelCnt);
+
+        // the rest of the chain gets blitted from the smallest stored level, where the format allows
+        VkFormatProperties formatProps;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice_, format, &formatProps);
+        constexpr VkFormatFeatureFlags BLIT_FEATURES = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT
+            | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+        bool generate = storedLevelCnt < fullLevelCnt && (formatProps.optimalTilingFeatures & BLIT_FEATURES) == BLIT_FEATURES;
+
+        VkImageCreateInfo imageInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = format,
+            .extent = { width, height, 1 },
+            .mipLevels = generate ? fullLevelCnt : storedLevelCnt,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | (generate ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : VkImageUsageFlags(0)),
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+        };
+
+        // the render thread doesn't look at the texture before its first chunk
+        Texture & texture = *_request.texture;
+        std::tie(texture.image, texture.memory) = allocator_->createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        texture.format = format;
+        texture.extent = { width, height };
+        texture.levelCnt = imageInfo.mipLevels;
+        texture.storedLevelCnt = storedLevelCnt;
+
+        for(uint32_t level = storedLevelCnt; level-- > 0; ) {
+            uint64_t byteOffset, byteLength;
+            std::memcpy(&byteOffset, file.data() + LEVEL_INDEX_OFFSET + level * 3 * sizeof(uint64_t), sizeof(byteOffset));
+            std::memcpy(&byteLength, file.data() + LEVEL_INDEX_OFFSET + level * 3 * sizeof(uint64_t) + 8, sizeof(byteLength));
+
+            uint32_t levelWidth = std::max(width >> level, 1U), levelHeight = std::max(height >> level, 1U);
+            VkDeviceSize rowSize = VkDeviceSize(levelWidth) * texelSz;
+
+            if(byteLength != rowSize * levelHeight || byteOffset + byteLength > file.size())
+                throw fail("level " + std::to_string(level) + " doesn't match its extent");
+            if(rowSize > ringSize_ / 2)
+                throw fail("rows are larger than the staging ring allows");
+
+            uint32_t rowsPerChunk = uint32_t(std::max<VkDeviceSize>(chunkSize_ / rowSize, 1));
+            for(uint32_t row = 0; row< levelHeight; row += rowsPerChunk) {
+                Chunk chunk = {
+                    .texture = _request.handle,
+                    .level = level,
+                    .firstRow = row,
+                    .rowCnt = std::min(rowsPerChunk, levelHeight - row),
+                    .lastOfLevel = row + rowsPerChunk >= levelHeight
+                };
+                chunk.size = chunk.rowCnt * rowSize;
+
+                if(!reserve(chunk))
+                    return;
+
+                // the only copy on the CPU side, page faults of the mapping land on this thread
+                std::memcpy(static_cast<char *>(ringMemory_.mapped) + chunk.ringOffset,
+                    file.data() + byteOffset + row * rowSize, chunk.size);
+
+                std::lock_guard lock(mutex_);
+                ready_.push_back(std::move(chunk));
+            }
+        }
+    }
+
+    // blocks until the ring has contiguous room for the chunk, false: quitting
+    bool reserve(Chunk & _chunk) {
+        std::unique_lock lock(mutex_);
+
+        VkDeviceSize offset = head_ % ringSize_;
+        // a chunk doesn't wrap, the end of the ring is skipped instead
+        VkDeviceSize padding = offset + _chunk.size > ringSize_ ? ringSize_ - offset : 0;
+        VkDeviceSize needed = padding + (_chunk.size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+        spaceCv_.wait(lock, [&] { return quit_ || ringSize_ - (head_ - tail_) >= needed; });
+        if(quit_)
+            return false;
+
+        _chunk.ringOffset = padding != 0 ? 0 : offset;
+        head_ += needed;
+        _chunk.ringEnd = head_;
+        return true;
+    }
+
+    // render thread
+    void recordChunk(VkCommandBuffer _cmdBuf, Slot & _slot, const Chunk & _chunk) {
+        Texture & texture = textures_[_chunk.texture];
+
+        if(!texture.started) {
+            barrier(_cmdBuf, texture.image, 0, texture.levelCnt, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+            texture.started = true;
+        }
+
+        VkBufferImageCopy region = {
+            .bufferOffset = _chunk.ringOffset,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, _chunk.level, 0, 1 },
+            .imageOffset = { 0, int32_t(_chunk.firstRow), 0 },
+            .imageExtent = { std::max(texture.extent.width >> _chunk.level, 1U), _chunk.rowCnt, 1 }
+        };
+        vkCmdCopyBufferToImage(_cmdBuf, ring_, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        if(!_chunk.lastOfLevel)
+            return;
+
+        uint32_t level = _chunk.level;
+        if(level == texture.storedLevelCnt - 1 && texture.levelCnt > texture.storedLevelCnt)
+            generateLevels(_cmdBuf, texture, level);
+        else {
+            barrier(_cmdBuf, texture.image, level, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        }
+
+        // frames still in flight may sample the previous view
+        if(texture.view != VK_NULL_HANDLE)
+            _slot.retiredViews.push_back(texture.view);
+
+        texture.residentLevel = level;
+        texture.view = createView(texture);
+
+        if(level == 0)
+            ++stats_.loaded;
+    }
+
+    // blits the chain below _level down to 1x1, every level from _level on ends up readable
+    void generateLevels(VkCommandBuffer _cmdBuf, const Texture & _texture, uint32_t _level) noexcept {
+        for(uint32_t level = _level; level + 1< _texture.levelCnt; ++level) {
+            barrier(_cmdBuf, _texture.image, level, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+
+            auto extentOf = [&](uint32_t _l) {
+                return VkOffset3D { int32_t(std::max(_texture.extent.width >> _l, 1U)), int32_t(std::max(_texture.extent.height >> _l, 1U)), 1 };
+            };
+
+            VkImageBlit blit = {
+                .srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 },
+                .srcOffsets = { { 0, 0, 0 }, extentOf(level) },
+                .dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level + 1, 0, 1 },
+                .dstOffsets = { { 0, 0, 0 }, extentOf(level + 1) }
+            };
+            vkCmdBlitImage(_cmdBuf, _texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                _texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+            barrier(_cmdBuf, _texture.image, level, 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        }
+
+        barrier(_cmdBuf, _texture.image, _texture.levelCnt - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+
+    // the resident levels only, the others are still being written
+    VkImageView createView(const Texture & _texture) {
+        VkImageViewCreateInfo viewInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = _texture.image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = _texture.format,
+            .subresourceRange = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = _texture.residentLevel,
+                .levelCount = _texture.levelCnt - _texture.residentLevel,
+                .baseArrayLayer = 0,
+                .layerCount = 1
+            }
+        };
+
+        VkImageView view;
+        if(vkCreateImageView(device_, &viewInfo, nullptr, &view) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create texture view");
+
+        return view;
+    }
+
+    static void barrier(VkCommandBuffer _cmdBuf, VkImage _image, uint32_t _level, uint32_t _levelCnt,
+        VkImageLayout _oldLayout, VkImageLayout _newLayout,
+        VkPipelineStageFlags _srcStage, VkAccessFlags _srcAccess, VkPipelineStageFlags _dstStage, VkAccessFlags _dstAccess) noexcept {
+        VkImageMemoryBarrier barrier = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = _srcAccess,
+            .dstAccessMask = _dstAccess,
+            .oldLayout = _oldLayout,
+            .newLayout = _newLayout,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = _image,
+            .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, _level, _levelCnt, 0, 1 }
+        };
+        vkCmdPipelineBarrier(_cmdBuf, _srcStage, _dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+};
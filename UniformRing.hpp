@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+#include <vulkan/vulkan.h>
+
+#include "MemoryAllocator.hpp"
+
+// Per-frame uniform data in one persistently mapped, host-coherent buffer, a region per frame slot.
+// Writing a block is a bump allocation and a memcpy; shaders read it through a UNIFORM_BUFFER_DYNAMIC
+// descriptor bound once, the returned offset is the dynamic offset.
+class UniformRing {
+public:
+    static constexpr VkDeviceSize DEFAULT_SLOT_SIZE = 64ULL << 10;
+
+    // _alignment: minUniformBufferOffsetAlignment
+    void init(VkDevice _device, MemoryAllocator & _allocator, VkDeviceSize _alignment, uint32_t _slotCnt,
+        VkDeviceSize _slotSize = DEFAULT_SLOT_SIZE) {
+        device_ = _device;
+        allocator_ = &_allocator;
+        alignment_ = std::max<VkDeviceSize>(_alignment, 1);
+        slotSize_ = alignUp(_slotSize);
+
+        // device-local where the host can write it directly (BAR/ReBAR/UMA)
+        std::tie(buffer_, memory_) = allocator_->createBuffer(slotSize_ * _slotCnt, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+
+    void destroy() noexcept {
+        if(buffer_ != VK_NULL_HANDLE)
+            allocator_->destroyBuffer(buffer_, memory_);
+        buffer_ = VK_NULL_HANDLE;
+    }
+
+    // starts writing the slot over, its previous frame must be complete
+    void begin(uint32_t _slot) noexcept {
+        base_ = slotSize_ * _slot;
+        head_ = 0;
+    }
+
+    // copies _size bytes into the current slot, returns the dynamic offset of the copy
+    uint32_t push(const void * _data, VkDeviceSize _size) {
+        if(head_ + _size > slotSize_)
+            throw std::runtime_error("Uniform ring slot overflow(" + std::to_string(slotSize_) + " bytes)");
+
+        VkDeviceSize offset = base_ + head_;
+        std::memcpy(static_cast<char *>(memory_.mapped) + offset, _data, _size);
+        head_ = alignUp(head_ + _size);
+
+        return static_cast<uint32_t>(offset);
+    }
+
+    template<typename T>
+    uint32_t push(const T & _data) {
+        return push(&_data, sizeof(T));
+    }
+
+    VkBuffer buffer() const noexcept {
+        return buffer_;
+    }
+
+    VkDeviceSize slotSize() const noexcept {
+        return slotSize_;
+    }
+
+private:
+    VkDevice device_ = VK_NULL_HANDLE;
+    MemoryAllocator * allocator_ = nullptr;
+
+    VkBuffer buffer_ = VK_NULL_HANDLE;
+    MemoryAllocator::Allocation memory_;
+    VkDeviceSize alignment_ = 1, slotSize_ = 0;
+    VkDeviceSize base_ = 0, head_ = 0; // of the current slot
+
+    VkDeviceSize alignUp(VkDeviceSize _value) const noexcept {
+        return (_value + alignment_ - 1) / alignment_ * alignment_;
+    }
+};
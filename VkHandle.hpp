@@ -0,0 +1,117 @@
+#pragma once
+
+#include <utility>
+
+#include <vulkan/vulkan.h>
+
+#include "MemoryAllocator.hpp"
+
+// Move-only owner of a device child handle, destroyed with Destroy(device, handle, nullptr)
+// when it goes out of scope, gets reset or reassigned. Hand it to a DeletionQueue while the GPU may still use it
+template<typename Handle, void (*Destroy)(VkDevice, Handle, const VkAllocationCallbacks *)>
+class VkHandle {
+public:
+    VkHandle() = default;
+
+    VkHandle(VkDevice _device, Handle _handle) noexcept : device_(_device), handle_(_handle) {}
+
+    ~VkHandle() {
+        reset();
+    }
+
+    VkHandle(VkHandle && _other) noexcept
+        : device_(_other.device_), handle_(std::exchange(_other.handle_, VK_NULL_HANDLE)) {}
+
+    VkHandle & operator=(VkHandle && _other) noexcept {
+        if(this != &_other) {
+            reset();
+            device_ = _other.device_;
+            handle_ = std::exchange(_other.handle_, VK_NULL_HANDLE);
+        }
+        return *this;
+    }
+
+    VkHandle(const VkHandle &) = delete;
+    VkHandle & operator=(const VkHandle &) = delete;
+
+    Handle get() const noexcept {
+        return handle_;
+    }
+
+    explicit operator bool() const noexcept {
+        return handle_ != VK_NULL_HANDLE;
+    }
+
+    void reset() noexcept {
+        if(handle_ != VK_NULL_HANDLE)
+            Destroy(device_, handle_, nullptr);
+        handle_ = VK_NULL_HANDLE;
+    }
+
+private:
+    VkDevice device_ = VK_NULL_HANDLE;
+    Handle handle_ = VK_NULL_HANDLE;
+};
+
+using UniqueSwapchain = VkHandle<VkSwapchainKHR, vkDestroySwapchainKHR>;
+using UniqueImageView = VkHandle<VkImageView, vkDestroyImageView>;
+using UniqueFramebuffer = VkHandle<VkFramebuffer, vkDestroyFramebuffer>;
+
+// the same for a buffer or image and its memory from a MemoryAllocator
+template<typename Handle, void (MemoryAllocator::*Destroy)(Handle, MemoryAllocator::Allocation &) noexcept>
+class Allocated {
+public:
+    Allocated() = default;
+
+    // takes what MemoryAllocator::createBuffer()/createImage() return
+    Allocated(MemoryAllocator & _allocator, std::pair<Handle, MemoryAllocator::Allocation> _created) noexcept
+        : allocator_(&_allocator), handle_(_created.first), memory_(_created.second) {}
+
+    ~Allocated() {
+        reset();
+    }
+
+    Allocated(Allocated && _other) noexcept
+        : allocator_(_other.allocator_), handle_(std::exchange(_other.handle_, VK_NULL_HANDLE)),
+          memory_(std::exchange(_other.memory_, {})) {}
+
+    Allocated & operator=(Allocated && _other) noexcept {
+        if(this != &_other) {
+            reset();
+            allocator_ = _other.allocator_;
+            handle_ = std::exchange(_other.handle_, VK_NULL_HANDLE);
+            memory_ = std::exchange(_other.memory_, {});
+        }
+        return *this;
+    }
+
+    Allocated(const Allocated &) = delete;
+    Allocated & operator=(const Allocated &) = delete;
+
+    Handle get() const noexcept {
+        return handle_;
+    }
+
+    const MemoryAllocator::Allocation & memory() const noexcept {
+        return memory_;
+    }
+
+    explicit operator bool() const noexcept {
+        return handle_ != VK_NULL_HANDLE;
+    }
+
+    void reset() noexcept {
+        if(handle_ != VK_NULL_HANDLE)
+            (allocator_->*Destroy)(handle_, memory_);
+        handle_ = VK_NULL_HANDLE;
+        memory_ = {};
+    }
+
+private:
+    MemoryAllocator * allocator_ = nullptr;
+    Handle handle_ = VK_NULL_HANDLE;
+    MemoryAllocator::Allocation memory_;
+};
+
+using UniqueBuffer = Allocated<VkBuffer, &MemoryAllocator::destroyBuffer>;
+using UniqueImage = Allocated<VkImage, &MemoryAllocator::destroyImage>;
@@ -1,14 +1,49 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <future>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <optional>
 #include <set>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 #include <vulkan/vulkan.h>
 
-constexpr auto MAX_FRAMES_IN_FLIGHT = 2;
+#include "BindlessTable.hpp"
+#include "ComputeContext.hpp"
+#include "DebugLog.hpp"
+#include "DeletionQueue.hpp"
+#include "DeviceCapabilities.hpp"
+#include "FrameCapture.hpp"
+#include "GpuProfiler.hpp"
+#include "InstanceScene.hpp"
+#include "JobSystem.hpp"
+#include "MemoryAllocator.hpp"
+#include "PipelineCompiler.hpp"
+#include "PipelineStateCache.hpp"
+#include "PostProcess.hpp"
+#include "Shaders.hpp"
+#include "StagingUploader.hpp"
+#include "StartupTimeline.hpp"
+#include "TextureStreamer.hpp"
+#include "UniformRing.hpp"
+#include "VkHandle.hpp"
 
 const std::vector<const char *> __validationLyrs {
     "VK_LAYER_KHRONOS_validation"
@@ -42,141 +77,538 @@ void DestroyDebugUtilsMessengerEXT(VkInstance _instance,
     return;
 }
 
-struct QueueFamilyIndices {
-    std::optional<uint32_t> graphicsFamily; // gpu family
-    std::optional<uint32_t> presentFamily;
+struct Vertex {
+    float pos[2];
+    float color[3];
 
-    bool isComplete() noexcept {
-        return graphicsFamily.has_value() && presentFamily.has_value();
+    static VkVertexInputBindingDescription getBindingDescription() noexcept {
+        return {
+            .binding = 0,
+            .stride = sizeof(Vertex),
+            .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+        };
+    }
+
+    static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions() noexcept {
+        return {{
+            { .location = 0, .binding = 0, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(Vertex, pos) },
+            { .location = 1, .binding = 0, .format = VK_FORMAT_R32G32B32_SFLOAT, .offset = offsetof(Vertex, color) }
+        }};
     }
 };
 
+// set 1 of the graphics pipeline, std140, written to the uniform ring once per frame
+struct FrameUniforms {
+    float viewOffset[2];
+    float viewScale[2];
+    float time; // seconds since the first frame
+    float deltaTime;
+    float pad[2];
+};
+
+// per draw, through push constants, std430
+struct DrawConstants {
+    float tint[4];
+    uint32_t instanceBuffer; // bindless storage buffer index
+    uint32_t texture; // bindless image index, BindlessTable::NONE: untextured
+};
+constexpr VkShaderStageFlags DRAW_CONSTANTS_STAGES = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
 struct SwapChainSupportDetails {
     VkSurfaceCapabilitiesKHR capabilities;
     std::vector<VkSurfaceFormatKHR> formats;
     std::vector<VkPresentModeKHR> presentModes;
 };
 
+struct ProgramOptions {
+    // render into offscreen images instead of a window/swapchain
+    bool headless = false;
+    // 0: run until the window is closed (headless: 1 frame)
+    uint32_t frameCnt = 0;
+    // headless only, dumps the last rendered image as binary PPM
+    std::optional<std::string> readbackPath;
+    // streams every presented (headless: rendered) frame into a file of binary PPMs, see FrameCapture
+    std::optional<std::string> capturePath;
+    // readback buffers frames may queue up in before the writer falls behind
+    // (windowed: frames get dropped, headless: drawFrame() waits)
+    uint32_t captureSlotCnt = 4;
+    // frames the CPU may run ahead of the GPU, more trade latency for throughput
+    uint32_t framesInFlight = 2;
+    // VkPipelineCache blob, loaded at startup and written back at cleanup
+    std::string pipelineCachePath = "pipeline_cache.bin";
+    // development override, loads <dir>/<GLSL file name>.spv instead of the embedded SPIR-V
+    std::optional<std::string> shaderDir;
+    // draws recorded per frame, split across the recording threads
+    uint32_t drawCnt = 1;
+    // 0: hardware concurrency
+    uint32_t recordThreadCnt = 0;
+    // pipeline compiler threads, 0: half the hardware concurrency, at most 4
+    uint32_t pipelineThreadCnt = 0;
+    // measure recording throughput vs. thread count for this many draws, then exit
+    uint32_t benchRecordDrawCnt = 0;
+    // measure the per-draw cost of uniform ring writes vs. push constants for this many draws, then exit
+    uint32_t benchUniformDrawCnt = 0;
+    // 0: a single triangle, otherwise a grid of N x N quads
+    uint32_t meshGridSize = 0;
+    // instances of the mesh drawn per frame, the draws split them between each other
+    uint32_t instanceCnt = 1;
+    // sweep instance counts, reporting CPU update and GPU frame time per count, then exit
+    bool benchInstances = false;
+    // run y = a * x + y over this many floats on the compute queue, check the result on the CPU, then exit
+    uint32_t computeTestCnt = 0;
+    // frustum cull the instances in a compute pass and draw the visible ones with one indirect count draw
+    bool gpuCulling = false;
+    // tonemap and blur the frame in compute passes, on the compute queue overlapping the next frame where there is one
+    bool postProcess = false;
+    // keep the post-process passes on the graphics queue even with a separate compute queue
+    bool postSync = false;
+    // of the gaussian blur, 0: tonemap only
+    uint32_t blurRadius = 4;
+    // frame time with the post-process passes on the graphics vs. the compute queue, then exit
+    bool benchPost = false;
+    // also write the startup step timings as JSON
+    std::optional<std::string> startupJsonPath;
+    // KTX2 files streamed in the background, see TextureStreamer
+    std::vector<std::string> texturePaths;
+    // texture bytes uploaded per frame at most, bounds the frame time cost of streaming
+    uint32_t textureBudgetMiB = 8;
+    // depth buffer and multisampling, both transient attachments
+    bool depth = false;
+    uint32_t msaaSamples = 1; // clamped to what the device supports
+    // debug builds: validation messages the messenger subscribes to
+    VkDebugUtilsMessageSeverityFlagsEXT validationSeverities = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT
+        | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+    VkDebugUtilsMessageTypeFlagsEXT validationTypes = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT
+        | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT
+        | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+};
+
 class VkProgram {
 public:
 
-    VkProgram(int _width, int _height, const char * _title)
-        : width_(_width), height_(_height), title_(_title) {}
+    VkProgram(int _width, int _height, const char * _title, ProgramOptions _options = {})
+        : width_(_width), height_(_height), title_(_title), options_(std::move(_options)),
+          framesInFlight_(std::max(options_.framesInFlight, 1U)) {}
     void run() {
-        initWindow();
+        startup_.start();
+        if(!options_.headless)
+            startup_.time("initWindow", [&] { initWindow(); });
         initVulkan();
+        reportStartup();
         
-        mainLoop();
+        if(options_.benchRecordDrawCnt != 0)
+            benchmarkRecording(options_.benchRecordDrawCnt);
+        else if(options_.benchUniformDrawCnt != 0)
+            benchmarkUniforms(options_.benchUniformDrawCnt);
+        else if(options_.benchInstances)
+            benchmarkInstances();
+        else if(options_.computeTestCnt != 0)
+            testCompute(options_.computeTestCnt);
+        else if(options_.benchPost)
+            benchmarkPost();
+        else
+            mainLoop();
 
         cleanup();
     }
 
+    // rolling GPU time of the recorded frame work, see GpuProfiler
+    GpuProfiler::FrameStats gpuFrameStats() const {
+        return gpuProfiler_.stats();
+    }
+
 private:
-    GLFWwindow * window_;
+    GLFWwindow * window_ = nullptr;
     int width_, height_;
     std::string title_;
+    ProgramOptions options_;
+    uint32_t framesInFlight_;
 
     VkInstance instance_;
 
 #ifndef NDEBUG
     VkDebugUtilsMessengerEXT dbgMessenger_;
 #endif
+    DebugLog debugLog_;
 
-    VkSurfaceKHR surface_;
+    VkSurfaceKHR surface_ = VK_NULL_HANDLE;
 
     VkPhysicalDevice physicalDevice_ = VK_NULL_HANDLE;
+    DeviceCapabilities deviceCaps_; // of physicalDevice_, set once by pickPhysicalDevice()
     VkDevice device_;
 
     VkQueue graphicsQueue_;
     VkQueue presentQueue_;
+    VkQueue transferQueue_; // graphicsQueue_ without a transfer-only family
+    VkQueue computeQueue_; // of a compute-only family if there is one, may be graphicsQueue_
 
-    VkSwapchainKHR swapChain_;
+    UniqueSwapchain swapChain_;
     std::vector<VkImage> swapChainImages_;
     VkFormat swapChainImageFormat_;
     VkExtent2D swapChainExtent_;
-    std::vector<VkImageView> swapChainImageViews_;
-    std::vector<VkFramebuffer> swapChainFrameBuffers_;
-
-    VkRenderPass renderPass_;
+    std::vector<UniqueImageView> swapChainImageViews_;
+    std::vector<UniqueFramebuffer> swapChainFrameBuffers_;
+
+    // headless: device-local render targets standing in for swapChainImages_
+    std::vector<MemoryAllocator::Allocation> offscreenImageMemory_;
+
+    // only live within the render pass, so one of each serves all frames in flight
+    struct TransientAttachment {
+        UniqueImage image;
+        UniqueImageView view;
+    };
+    TransientAttachment msaaColorAttachment_, depthAttachment_; // no image: not used
+    VkSampleCountFlagBits sampleCnt_ = VK_SAMPLE_COUNT_1_BIT;
+    VkFormat depthFormat_ = VK_FORMAT_UNDEFINED; // VK_FORMAT_UNDEFINED: no depth
+    uint32_t lastImageIndex_ = 0;
+
+    VkRenderPass renderPass_; // owned by pipelineStates_
+    // set 0 of the graphics pipeline, every instance buffer and scene texture by index
+    BindlessTable bindless_;
+    VkDescriptorSet bindlessSet_ = VK_NULL_HANDLE; // of the frame being recorded
+    VkDescriptorSetLayout frameSetLayout_; // the dynamic uniform buffer of FrameUniforms
     VkPipelineLayout pipelineLayout_;
-    VkPipeline graphicsPipeline_;
+    GraphicsPipelineDesc graphicsPipelineDesc_;
+    // looked up every frame, VK_NULL_HANDLE until the compiler delivers it, frames only clear meanwhile
+    VkPipeline graphicsPipeline_ = VK_NULL_HANDLE;
+    PipelineCompiler pipelineCompiler_;
+    // owns every render pass, pipeline layout and graphics pipeline
+    PipelineStateCache pipelineStates_;
+
+    FrameCapture frameCapture_;
+
+    VkPipelineCache pipelineCache_ = VK_NULL_HANDLE;
+    bool pipelineCacheWarm_ = false;
+    // VK_EXT_pipeline_creation_feedback is enabled, without it hits and misses aren't counted
+    bool pipelineCreationFeedback_ = false;
+    uint32_t pipelineCacheHits_ = 0, pipelineCacheMisses_ = 0;
 
     VkCommandPool commandPool_;
-    std::vector<VkCommandBuffer> commandBuffers_;
 
+    // re-recorded every frame: the primary buffer executes secondaries recorded in parallel
+    struct FrameCommands {
+        VkCommandPool primaryPool;
+        VkCommandBuffer primary;
+        // a transient pool per recording thread, reset wholesale instead of per buffer
+        std::vector<VkCommandPool> threadPools;
+        std::vector<std::vector<VkCommandBuffer>> threadBuffers;
+        std::vector<uint32_t> threadBuffersUsed;
+    };
+    std::vector<FrameCommands> frameCommands_;
+    std::unique_ptr<JobSystem> recordJobs_; // also runs the scene update, ahead of recording
+
+    // binary, the swapchain can't use timeline semaphores
     std::vector<VkSemaphore> imageAvailableSemaphores_;
     std::vector<VkSemaphore> renderFinishedSemaphores_;
-    std::vector<VkFence> inFlightFences_;
-    std::vector<VkFence> imagesInFlight_;
-    size_t currentFrame_;
+    // signaled with the frame number (frameCnt_ after submission) by every graphics submit
+    VkSemaphore graphicsTimeline_;
+    // frame number of the last submission using the frame slot/swapchain image, 0: none
+    std::vector<uint64_t> frameSlotValues_;
+    std::vector<uint64_t> imageFrameValues_;
+    size_t currentFrame_ = 0;
+    uint64_t frameCnt_ = 0; // submitted so far
+
+    // CPU time drawFrame() spent blocked on the GPU
+    std::array<double, GpuProfiler::HISTORY_SIZE> cpuWaitHistory_ {};
+    size_t cpuWaitHead_ = 0, cpuWaitCnt_ = 0;
+
+    bool frameBufferResized_ = false;
+
+    // replaced by recreateSwapChain(), retired to deletionQueue_ as a whole
+    struct SwapChainResources {
+        UniqueSwapchain swapChain;
+        std::vector<UniqueImageView> imageViews;
+        std::vector<UniqueFramebuffer> frameBuffers;
+        std::vector<TransientAttachment> attachments;
+    };
+
+    // what gets replaced at runtime, destroyed once no submitted frame can reference it, keyed on graphicsTimeline_
+    DeletionQueue deletionQueue_;
+
+    GpuProfiler gpuProfiler_;
+
+    MemoryAllocator allocator_;
+
+    StagingUploader uploader_;
+    ComputeContext compute_;
+    PostProcess post_;
+    PostProcess::Wait postWait_; // of the frame recorded last
+    TextureStreamer textures_;
+    struct SceneTexture {
+        TextureStreamer::Handle handle;
+        VkImageView view = VK_NULL_HANDLE; // last one handed to bindless_
+        uint32_t bindlessIndex = BindlessTable::NONE;
+    };
+    std::vector<SceneTexture> sceneTextures_;
+
+    struct Mesh {
+        VkBuffer vertexBuffer = VK_NULL_HANDLE;
+        MemoryAllocator::Allocation vertexMemory;
+        VkBuffer indexBuffer = VK_NULL_HANDLE;
+        MemoryAllocator::Allocation indexMemory;
+        uint32_t indexCnt = 0;
+        float boundingRadius = 0.0F; // around the origin
+        // the index upload, queued after the vertex upload
+        uint64_t uploadTicket = 0;
+    };
+    Mesh mesh_;
+
+    // written by the CPU every frame, read by the vertex shader through gl_InstanceIndex
+    struct FrameInstances {
+        UniqueBuffer buffer;
+        uint32_t capacity = 0;
+        uint32_t visibleCnt = 0; // packed by the frame's scene update, what the draws cover
+        uint32_t bindlessIndex = BindlessTable::NONE;
+
+        // gpu culling: a VkDrawIndexedIndirectCommand per visible instance and their count
+        UniqueBuffer drawBuffer;
+        UniqueBuffer drawCountBuffer;
+        VkDescriptorSet cullDescriptorSet;
+    };
+    std::vector<FrameInstances> frameInstances_;
+    VkDescriptorPool descriptorPool_;
+
+    // one descriptor set for all frames, each frame only moves the dynamic offset
+    UniformRing uniformRing_;
+    VkDescriptorPool uniformPool_;
+    VkDescriptorSet frameSet_;
+    uint32_t frameUniformOffset_ = 0; // of the frame being recorded
+    std::chrono::steady_clock::time_point firstFrame_, lastFrame_;
+
+    // options_.gpuCulling, if the device can do it
+    bool gpuCulling_ = false;
+    VkDescriptorSetLayout cullSetLayout_ = VK_NULL_HANDLE;
+    VkPipelineLayout cullPipelineLayout_ = VK_NULL_HANDLE;
+    VkPipeline cullPipeline_ = VK_NULL_HANDLE;
+
+    double recordMs_ = 0.0; // CPU time recording the last frame
+
+    InstanceScene instanceScene_;
+    std::chrono::steady_clock::time_point lastInstanceUpdate_;
+    double instanceUpdateMs_ = 0.0; // of the last frame
+    uint32_t instanceVisibleCnt_ = 0;
+
+    StartupTimeline startup_;
 
     void initWindow() {
         glfwInit();
 
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
         window_ = glfwCreateWindow(width_, height_, title_.c_str(), nullptr, nullptr);
+        glfwSetWindowUserPointer(window_, this);
+        glfwSetFramebufferSizeCallback(window_, frameBufferResizeCallback);
+    }
+
+    static void frameBufferResizeCallback(GLFWwindow * _window, int _width, int _height) noexcept {
+        auto program = static_cast<VkProgram *>(glfwGetWindowUserPointer(_window));
+        program->frameBufferResized_ = true;
     }
 
     void initVulkan() {
-        createVkInstance();
 #ifndef NDEBUG
-        setupDebugMessenger();
+        // before the instance, its creation already reports through the messenger chained to it
+        debugLog_.start(options_.validationSeverities, options_.validationTypes);
 #endif
-        createSurface();
-        pickPhysicalDevice();
-        createLogicalDevice();
-        createSwapChain();
-        createImageViews();
-        createRenderPass();
-        createGraphicsPipeline();
-        createFrameBuffers();
-        createCommandPool();
-        createCommandBuffers();
-        createSyncObjects();
+        startup_.time("createVkInstance", [&] { createVkInstance(); });
+#ifndef NDEBUG
+        startup_.time("setupDebugMessenger", [&] { setupDebugMessenger(); });
+#endif
+        if(!options_.headless)
+            startup_.time("createSurface", [&] { createSurface(); });
+        startup_.time("pickPhysicalDevice", [&] { pickPhysicalDevice(); });
+        startup_.time("createLogicalDevice", [&] { createLogicalDevice(); });
+        startup_.time("initAllocator", [&] { allocator_.init(device_, deviceCaps_); });
+
+        // the render pass only needs the formats, known from the device snapshot,
+        // so shader loading and pipeline compilation overlap with the swapchain
+        // post-processing renders into its HDR scene images instead of the presented ones
+        VkFormat colorFormat = options_.postProcess ? PostProcess::SCENE_FORMAT : chooseColorFormat();
+        chooseTransientAttachments();
+        auto pipelines = std::async(std::launch::async, [this, colorFormat] {
+            startup_.time("createDescriptorSetLayout", [&] { createDescriptorSetLayout(); });
+            startup_.time("createPipelineCache", [&] { createPipelineCache(); });
+            startup_.time("initPipelineCompiler", [&] { initPipelineCompiler(); });
+            startup_.time("createRenderPass", [&] { createRenderPass(colorFormat); });
+            startup_.time("createGraphicsPipeline", [&] { createGraphicsPipeline(); });
+            if(gpuCulling_)
+                startup_.time("createCullPipeline", [&] { createCullPipeline(); });
+        });
+
+        auto commands = std::async(std::launch::async, [this] {
+            startup_.time("createCommandPool", [&] { createCommandPool(); });
+            startup_.time("createQueryPools", [&] { createQueryPools(); });
+            startup_.time("createCommandBuffers", [&] { createCommandBuffers(); });
+            startup_.time("createSyncObjects", [&] { createSyncObjects(); });
+        });
+
+        // stays on this thread, GLFW wants the framebuffer size queried from the main thread
+        if(options_.headless)
+            startup_.time("createOffscreenTargets", [&] { createOffscreenTargets(); });
+        else
+            startup_.time("createSwapChain", [&] { createSwapChain(); });
+        startup_.time("createImageViews", [&] { createImageViews(); });
+        startup_.time("createTransientAttachments", [&] { createTransientAttachments(); });
+
+        commands.get();
+        pipelines.get();
+
+        deletionQueue_.init(device_, graphicsTimeline_);
+
+        imageFrameValues_.assign(swapChainImages_.size(), 0);
+
+        if(options_.postProcess)
+            startup_.time("initPostProcess", [&] { initPostProcess(); });
+        startup_.time("createFrameBuffers", [&] { createFrameBuffers(); });
+        startup_.time("createStagingUploader", [&] { createStagingUploader(); });
+        startup_.time("initCompute", [&] { initCompute(); });
+        if(options_.capturePath)
+            startup_.time("createFrameCapture", [&] { createFrameCapture(); });
+        startup_.time("createTextureStreamer", [&] { createTextureStreamer(); });
+        startup_.time("createSceneMesh", [&] { createSceneMesh(); });
+        startup_.time("createInstanceBuffers", [&] { createInstanceBuffers(); });
+        startup_.time("createFrameUniforms", [&] { createFrameUniforms(); });
+
+        // runs that measure or read back frames want every frame drawn
+        if(options_.headless || options_.benchRecordDrawCnt != 0 || options_.benchUniformDrawCnt != 0 || options_.benchInstances
+            || options_.benchPost) {
+            startup_.time("waitForPipelines", [&] { pipelineCompiler_.waitIdle(); });
+            installPipelines();
+        }
+    }
+
+    void reportStartup() {
+        startup_.printTable(std::cout);
+
+        if(options_.startupJsonPath && !startup_.writeJson(*options_.startupJsonPath))
+            std::cerr << "Failed to write startup timings(\"" << *options_.startupJsonPath << "\")\n";
     }
 
     void mainLoop() {
+        if(options_.headless) {
+            uint32_t frameCnt = std::max(options_.frameCnt, 1U);
+            for(uint32_t i = 0; i< frameCnt; ++i)
+                drawFrame();
+
+            vkDeviceWaitIdle(device_);
+
+            logGpuFrameStats();
+            logCpuWaitStats();
+
+            if(options_.readbackPath)
+                readbackImage(lastImageIndex_, *options_.readbackPath);
+            return;
+        }
+
+        uint32_t frame = 0;
         while(!glfwWindowShouldClose(window_)) {
             glfwPollEvents();
             drawFrame();
+
+            if(options_.frameCnt != 0 && ++frame >= options_.frameCnt)
+                break;
         }
 
         vkDeviceWaitIdle(device_);
+
+        logGpuFrameStats();
+        logCpuWaitStats();
     }
 
     void cleanup() {
-        for(auto i = 0; i< MAX_FRAMES_IN_FLIGHT; ++i) {
+        // the writer still waits on the graphics timeline
+        if(options_.capturePath) {
+            frameCapture_.destroy();
+            frameCapture_.logStats(std::cout);
+        }
+
+        deletionQueue_.logStats(std::cout);
+        deletionQueue_.flush();
+
+        for(auto i = 0; i< framesInFlight_; ++i) {
             vkDestroySemaphore(device_, renderFinishedSemaphores_[i], nullptr);
             vkDestroySemaphore(device_, imageAvailableSemaphores_[i], nullptr);
-            vkDestroyFence(device_, inFlightFences_[i], nullptr);
+        }
+        vkDestroySemaphore(device_, graphicsTimeline_, nullptr);
+
+        gpuProfiler_.destroy();
+
+        destroyMesh(mesh_);
+        uploader_.destroy();
+
+        compute_.logStats(std::cout);
+        compute_.destroy();
+
+        if(options_.postProcess) {
+            post_.logStats(std::cout);
+            post_.destroy();
+        }
+
+        textures_.logStats(std::cout);
+        textures_.destroy();
+
+        frameInstances_.clear();
+        vkDestroyDescriptorPool(device_, descriptorPool_, nullptr);
+
+        uniformRing_.destroy();
+        vkDestroyDescriptorPool(device_, uniformPool_, nullptr);
+
+        if(gpuCulling_) {
+            vkDestroyPipeline(device_, cullPipeline_, nullptr);
+            vkDestroyDescriptorSetLayout(device_, cullSetLayout_, nullptr);
+        }
+
+        recordJobs_.reset();
+        for(auto & frame : frameCommands_) {
+            for(auto pool : frame.threadPools)
+                vkDestroyCommandPool(device_, pool, nullptr);
+            vkDestroyCommandPool(device_, frame.primaryPool, nullptr);
         }
 
         vkDestroyCommandPool(device_, commandPool_, nullptr);
 
-        for(auto frameBuffer : swapChainFrameBuffers_)
-            vkDestroyFramebuffer(device_, frameBuffer, nullptr);
+        swapChainFrameBuffers_.clear();
+
+        pipelineCompiler_.destroy();
+        pipelineStates_.logStats(std::cout);
+        pipelineStates_.destroy();
+        bindless_.logStats(std::cout);
+        bindless_.destroy();
+        vkDestroyDescriptorSetLayout(device_, frameSetLayout_, nullptr);
 
-        vkDestroyPipeline(device_, graphicsPipeline_, nullptr);
-        vkDestroyPipelineLayout(device_, pipelineLayout_, nullptr);
-        vkDestroyRenderPass(device_, renderPass_, nullptr);
+        savePipelineCache();
+        vkDestroyPipelineCache(device_, pipelineCache_, nullptr);
 
-        for(auto imgView : swapChainImageViews_)
-            vkDestroyImageView(device_, imgView, nullptr);
+        swapChainImageViews_.clear();
 
-        vkDestroySwapchainKHR(device_, swapChain_, nullptr);
+        logTransientAttachmentMemory();
+        msaaColorAttachment_ = {};
+        depthAttachment_ = {};
+
+        if(options_.headless) {
+            for(auto i = 0; i< swapChainImages_.size(); ++i)
+                allocator_.destroyImage(swapChainImages_[i], offscreenImageMemory_[i]);
+        } else
+            swapChain_.reset();
+
+        allocator_.logStats();
+        allocator_.destroy();
         vkDestroyDevice(device_, nullptr);
 
 #ifndef NDEBUG
         DestroyDebugUtilsMessengerEXT(instance_, dbgMessenger_, nullptr);
 #endif
 
-        vkDestroySurfaceKHR(instance_, surface_, nullptr);
+        if(!options_.headless)
+            vkDestroySurfaceKHR(instance_, surface_, nullptr);
         vkDestroyInstance(instance_, nullptr);
+        debugLog_.stop();
 
-        glfwDestroyWindow(window_);
-        glfwTerminate();
+        if(!options_.headless) {
+            glfwDestroyWindow(window_);
+            glfwTerminate();
+        }
     }
 
     void createVkInstance() {
@@ -199,10 +631,6 @@ private:
             .pApplicationInfo = &appInfo
         };
 
-        uint glfwExtCnt = 0;
-        const char ** glfwExts;
-        glfwExts = glfwGetRequiredInstanceExtensions(&glfwExtCnt);
-
         auto exts = getRequiredExtensions();
         instcInfo.enabledExtensionCount = exts.size();
         instcInfo.ppEnabledExtensionNames = exts.data();
@@ -229,15 +657,11 @@ private:
     void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT & createInfo) noexcept {
         createInfo = {
             .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT,
-            .messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT
-                | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT
-                | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT
-            ,
-            .messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT
-                | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT
-                | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT
-            ,
-            .pfnUserCallback = _debugCallBack
+            // whatever isn't subscribed to the layers don't even format
+            .messageSeverity = options_.validationSeverities,
+            .messageType = options_.validationTypes,
+            .pfnUserCallback = DebugLog::callback,
+            .pUserData = &debugLog_
         };
     }
 
@@ -269,24 +693,39 @@ private:
         std::vector<VkPhysicalDevice> devices(deviceCnt);
         vkEnumeratePhysicalDevices(instance_, &deviceCnt, devices.data());
 
+        // the highest scoring suitable device wins, enumeration order says nothing about it
+        std::optional<DeviceCapabilities> best;
         for(const auto & device : devices) {
-            if(isDeviceSuitable(device)) {
-                physicalDevice_ = device;
-                break;
-            }
+            auto caps = DeviceCapabilities::query(device, surface_);
+            bool suitable = isDeviceSuitable(caps);
+
+            std::cout << "GPU " << caps.properties.deviceName << ": "
+                << (suitable ? "score " + std::to_string(caps.score()) : std::string("unsuitable"))
+                << ", " << (caps.deviceLocalBytes >> 20) << " MiB device-local\n";
+
+            if(suitable && (!best || caps.score() > best->score()))
+                best = std::move(caps);
         }
 
-        if(physicalDevice_ == VK_NULL_HANDLE)
+        if(!best)
             throw std::runtime_error("Failed to find a suitable GPU device");
 
+        deviceCaps_ = std::move(*best);
+        physicalDevice_ = deviceCaps_.physicalDevice;
+
+        std::cout << "Using " << deviceCaps_.properties.deviceName << "\n";
+
         return;
     }
 
     void createLogicalDevice() {
-        QueueFamilyIndices indices = findQueueFamilies(physicalDevice_);
+        const QueueFamilyIndices & indices = deviceCaps_.queueFamilyIndices;
 
         std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
         std::set<uint32_t> uniqueQueueFamilies { indices.graphicsFamily.value(), indices.presentFamily.value() };
+        if(indices.transferFamily)
+            uniqueQueueFamilies.insert(*indices.transferFamily);
+        uniqueQueueFamilies.insert(indices.computeFamily.value());
 
         float queuePriority = 1.0F;
         for(uint32_t queueFamily : uniqueQueueFamilies) {
@@ -299,20 +738,68 @@ private:
             queueCreateInfos.push_back(queueCreateInfo);
         }
 
+        const VkPhysicalDeviceFeatures & supportedFeatures = deviceCaps_.features;
+        const VkPhysicalDeviceVulkan12Features & supportedFeatures12 = deviceCaps_.features12;
+
         VkPhysicalDeviceFeatures deviceFeatures {};
+        // the draws are recorded into secondaries, they have to inherit the profiler's statistics query
+        deviceFeatures.pipelineStatisticsQuery = hasPipelineStatistics();
+        deviceFeatures.inheritedQueries = hasPipelineStatistics();
+
+        VkPhysicalDeviceVulkan12Features features12 = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES
+        };
+
+        // frame pacing
+        if(!supportedFeatures12.timelineSemaphore)
+            throw std::runtime_error("Timeline semaphores are required");
+        features12.timelineSemaphore = VK_TRUE;
+
+        // bindless descriptors
+        if(!hasBindlessFeatures(deviceCaps_))
+            throw std::runtime_error("Descriptor indexing with update-after-bind is required");
+        deviceFeatures.shaderStorageBufferArrayDynamicIndexing = VK_TRUE;
+        deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+        features12.runtimeDescriptorArray = VK_TRUE;
+        features12.descriptorBindingPartiallyBound = VK_TRUE;
+        features12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        features12.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+
+        if(options_.gpuCulling) {
+            // the cull pass is dispatched on the graphics queue, its draws pick the instance with firstInstance
+            gpuCulling_ = supportedFeatures12.drawIndirectCount && supportedFeatures.multiDrawIndirect
+                && supportedFeatures.drawIndirectFirstInstance
+                && (deviceCaps_.queueFamilies[indices.graphicsFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT);
+
+            if(gpuCulling_) {
+                features12.drawIndirectCount = VK_TRUE;
+                deviceFeatures.multiDrawIndirect = VK_TRUE;
+                deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+            } else
+                std::cerr << "GPU culling needs drawIndirectCount, multiDrawIndirect and drawIndirectFirstInstance, drawing from the CPU\n";
+        }
 
         VkDeviceCreateInfo deviceCreateInfo = {
             .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+            .pNext = &features12,
 
             .queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size()),
             .pQueueCreateInfos = queueCreateInfos.data(),
 
             .pEnabledFeatures = &deviceFeatures,
 
-            .enabledExtensionCount = static_cast<uint32_t>(__deviceExts.size()),
-            .ppEnabledExtensionNames = __deviceExts.data()
         };
 
+        auto deviceExts = getRequiredDeviceExtensions();
+
+        // only reports whether pipeline creation hit the cache
+        pipelineCreationFeedback_ = deviceCaps_.supportsExtensions({ VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME });
+        if(pipelineCreationFeedback_)
+            deviceExts.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+
+        deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExts.size());
+        deviceCreateInfo.ppEnabledExtensionNames = deviceExts.data();
+
 #ifndef NDEBUG
         deviceCreateInfo.enabledLayerCount = __validationLyrs.size();
         deviceCreateInfo.ppEnabledLayerNames = __validationLyrs.data();
@@ -325,10 +812,12 @@ private:
         
         vkGetDeviceQueue(device_, indices.graphicsFamily.value(), 0, &graphicsQueue_);
         vkGetDeviceQueue(device_, indices.presentFamily.value(), 0, &presentQueue_);
+        vkGetDeviceQueue(device_, indices.transferFamily.value_or(indices.graphicsFamily.value()), 0, &transferQueue_);
+        vkGetDeviceQueue(device_, indices.computeFamily.value(), 0, &computeQueue_);
     }
 
-    void createSwapChain() {
-        SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice_);
+    void createSwapChain(VkSwapchainKHR _oldSwapChain = VK_NULL_HANDLE) {
+        SwapChainSupportDetails swapChainSupport = querySwapChainSupport();
 
         VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
         VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
@@ -352,7 +841,21 @@ private:
             .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT // color buffer?
         };
 
-        QueueFamilyIndices indices = findQueueFamilies(physicalDevice_);
+        // captured frames are copied out of the swapchain images
+        if(options_.capturePath) {
+            if(!(swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT))
+                throw std::runtime_error("The swapchain doesn't support copies from its images, --capture needs them");
+            createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        }
+
+        // the post-processed frame is blitted into them
+        if(options_.postProcess) {
+            if(!(swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
+                throw std::runtime_error("The swapchain doesn't support copies into its images, --post needs them");
+            createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        }
+
+        const QueueFamilyIndices & indices = deviceCaps_.queueFamilyIndices;
         uint32_t queueFamilyIndices[] = { indices.graphicsFamily.value(), indices.presentFamily.value() };
 
         if(indices.graphicsFamily != indices.presentFamily) {
@@ -367,21 +870,105 @@ private:
         createInfo.presentMode = presentMode;
         createInfo.clipped = VK_TRUE;
 
-        createInfo.oldSwapchain = VK_NULL_HANDLE;
+        // lets the presentation engine hand the old images' resources over
+        createInfo.oldSwapchain = _oldSwapChain;
 
-        if(vkCreateSwapchainKHR(device_, &createInfo, nullptr, &swapChain_) != VK_SUCCESS)
+        VkSwapchainKHR swapChain;
+        if(vkCreateSwapchainKHR(device_, &createInfo, nullptr, &swapChain) != VK_SUCCESS)
             throw std::runtime_error("Failed to create swapchain");
+        swapChain_ = UniqueSwapchain(device_, swapChain);
         
-        vkGetSwapchainImagesKHR(device_, swapChain_, &imageCnt, nullptr);
+        vkGetSwapchainImagesKHR(device_, swapChain, &imageCnt, nullptr);
         swapChainImages_.resize(imageCnt);
-        vkGetSwapchainImagesKHR(device_, swapChain_, &imageCnt, swapChainImages_.data());
+        vkGetSwapchainImagesKHR(device_, swapChain, &imageCnt, swapChainImages_.data());
 
         swapChainImageFormat_ = surfaceFormat.format;
         swapChainExtent_ = extent;
     }
 
+    // rebuilds only what depends on the swapchain images, the pipeline
+    // uses dynamic viewport/scissor and survives unless the surface format changes
+    void recreateSwapChain() {
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(window_, &width, &height);
+
+        // minimized, nothing to present to
+        while(width == 0 || height == 0) {
+            glfwWaitEvents();
+            glfwGetFramebufferSize(window_, &width, &height);
+        }
+
+        SwapChainResources retired = {
+            .swapChain = std::move(swapChain_),
+            .imageViews = std::move(swapChainImageViews_),
+            .frameBuffers = std::move(swapChainFrameBuffers_)
+        };
+
+        // sized like the swapchain, frames still in flight may be using them
+        for(auto attachment : { &msaaColorAttachment_, &depthAttachment_ }) {
+            if(attachment->image)
+                retired.attachments.push_back(std::exchange(*attachment, {}));
+        }
+
+        auto oldFormat = swapChainImageFormat_;
+
+        createSwapChain(retired.swapChain.get());
+        createImageViews();
+        createTransientAttachments();
+
+        // frames in flight keep the old scene images
+        if(options_.postProcess)
+            post_.resize(swapChainExtent_, frameCnt_);
+
+        // the old render pass and pipeline stay in the cache, a switch back finds them again.
+        // post-processing renders into its own format
+        if(swapChainImageFormat_ != oldFormat && !options_.postProcess) {
+            createRenderPass(swapChainImageFormat_);
+            createGraphicsPipeline();
+        }
+
+        createFrameBuffers();
+
+        imageFrameValues_.assign(swapChainImages_.size(), 0);
+
+        // one more completed frame than the last one using it leaves presentation time to let go of the images
+        deletionQueue_.retire(frameCnt_ + 1, std::move(retired));
+    }
+
+    void createOffscreenTargets() {
+        swapChainImageFormat_ = chooseColorFormat();
+        swapChainExtent_ = { static_cast<uint32_t>(width_), static_cast<uint32_t>(height_) };
+
+        // one target per frame in flight, so a target is never rendered while still in use
+        swapChainImages_.resize(framesInFlight_);
+        offscreenImageMemory_.resize(framesInFlight_);
+
+        for(auto i = 0; i< swapChainImages_.size(); ++i) {
+            VkImageCreateInfo imageInfo = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                .imageType = VK_IMAGE_TYPE_2D,
+                .format = swapChainImageFormat_,
+                .extent = { swapChainExtent_.width, swapChainExtent_.height, 1 },
+                .mipLevels = 1,
+                .arrayLayers = 1,
+                .samples = VK_SAMPLE_COUNT_1_BIT,
+                .tiling = VK_IMAGE_TILING_OPTIMAL,
+                .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+            };
+
+            // the post-processed frame is blitted into them
+            if(options_.postProcess)
+                imageInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+            std::tie(swapChainImages_[i], offscreenImageMemory_[i]) =
+                allocator_.createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        }
+    }
+
     void createImageViews() {
-        swapChainImageViews_.resize(swapChainImages_.size());
+        swapChainImageViews_.clear();
 
         for(auto i = 0; i< swapChainImages_.size(); ++i) {
             VkImageViewCreateInfo createInfo = {
@@ -400,338 +987,1570 @@ private:
                 .subresourceRange.layerCount = 1
             };
 
-            if(vkCreateImageView(device_, &createInfo, nullptr, &swapChainImageViews_[i]) != VK_SUCCESS)
+            VkImageView view;
+            if(vkCreateImageView(device_, &createInfo, nullptr, &view) != VK_SUCCESS)
                 throw std::runtime_error("Failed to create image view" + std::to_string(i));
+            swapChainImageViews_.emplace_back(device_, view);
         }
     }
 
-    void createRenderPass() {
-        VkAttachmentDescription colorAttachment = {
-            .format = swapChainImageFormat_,
-            .samples = VK_SAMPLE_COUNT_1_BIT,
-            .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-            .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-            .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-            .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-            .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
-        };
+    // what the device supports of options_.depth and options_.msaaSamples
+    void chooseTransientAttachments() {
+        const auto & limits = deviceCaps_.properties.limits;
 
-        VkAttachmentReference colorAttachmentRef = {
-            .attachment = 0,
-            .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
-        };
+        if(options_.depth) {
+            for(auto format : { VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D16_UNORM }) {
+                VkFormatProperties props;
+                vkGetPhysicalDeviceFormatProperties(physicalDevice_, format, &props);
+                if(props.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+                    depthFormat_ = format;
+                    break;
+                }
+            }
 
-        VkSubpassDescription subpass = {
-            .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
-            .colorAttachmentCount = 1,
-            .pColorAttachments = &colorAttachmentRef
-        };
+            if(depthFormat_ == VK_FORMAT_UNDEFINED)
+                std::cerr << "No depth format available, rendering without depth\n";
+        }
 
-        VkRenderPassCreateInfo renderPassInfo = {
-            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-            .attachmentCount = 1,
-            .pAttachments = &colorAttachment,
-            .subpassCount = 1,
-            .pSubpasses = &subpass
-        };
+        VkSampleCountFlags supported = limits.framebufferColorSampleCounts;
+        if(depthFormat_ != VK_FORMAT_UNDEFINED)
+            supported &= limits.framebufferDepthSampleCounts;
+
+        // the highest supported count not above the requested one
+        for(uint32_t samples = std::min(options_.msaaSamples, 64U); samples > 1; samples >>= 1) {
+            if((samples & (samples - 1)) == 0 && (supported & samples)) {
+                sampleCnt_ = static_cast<VkSampleCountFlagBits>(samples);
+                break;
+            }
+        }
 
-        if(vkCreateRenderPass(device_, &renderPassInfo, nullptr, &renderPass_) != VK_SUCCESS)
-            throw std::runtime_error("Failed to create render pass");
+        if(sampleCnt_ != options_.msaaSamples && options_.msaaSamples > 1)
+            std::cerr << options_.msaaSamples << "x MSAA isn't supported, using " << sampleCnt_ << "x\n";
     }
 
-    void createGraphicsPipeline() {
-        // though using vulkan1.2, compiling SPIR-V code as vulkan1.1 has no any issue
-        // glslc -w -x glsl --target-env=vulkan1.1 -O (filename).(frag/vert) -o (filename).spv
-        auto fragShaderCode = readFile("frag.spv");
-        auto vertShaderCode = readFile("vert.spv");
+    // lazily allocated where the device has such memory, tile-based GPUs then never back them at all
+    void createTransientAttachments() {
+        auto create = [&](TransientAttachment & _attachment, VkFormat _format, VkImageUsageFlags _usage, VkImageAspectFlags _aspect) {
+            VkImageCreateInfo imageInfo = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                .imageType = VK_IMAGE_TYPE_2D,
+                .format = _format,
+                .extent = { swapChainExtent_.width, swapChainExtent_.height, 1 },
+                .mipLevels = 1,
+                .arrayLayers = 1,
+                .samples = sampleCnt_,
+                .tiling = VK_IMAGE_TILING_OPTIMAL,
+                .usage = _usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+            };
+
+            _attachment.image = UniqueImage(allocator_, allocator_.createImage(imageInfo,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT));
 
-        VkShaderModule fragShaderMod = createShaderModule(fragShaderCode);
-        VkShaderModule vertShaderMod = createShaderModule(vertShaderCode);
+            VkImageViewCreateInfo viewInfo = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                .image = _attachment.image.get(),
+                .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                .format = _format,
+                .subresourceRange = {
+                    .aspectMask = _aspect,
+                    .baseMipLevel = 0,
+                    .levelCount = 1,
+                    .baseArrayLayer = 0,
+                    .layerCount = 1
+                }
+            };
 
-        VkPipelineShaderStageCreateInfo fragShaderStageInfo = {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-            .module = fragShaderMod,
-            .pName = "main"
-        }, vertShaderStageInfo = {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-            .stage = VK_SHADER_STAGE_VERTEX_BIT,
-            .module = vertShaderMod,
-            .pName = "main"
+            VkImageView view;
+            if(vkCreateImageView(device_, &viewInfo, nullptr, &view) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create transient attachment view");
+            _attachment.view = UniqueImageView(device_, view);
         };
 
-        VkPipelineShaderStageCreateInfo shaderStages[] = { fragShaderStageInfo, vertShaderStageInfo };
+        if(sampleCnt_ != VK_SAMPLE_COUNT_1_BIT)
+            create(msaaColorAttachment_, options_.postProcess ? PostProcess::SCENE_FORMAT : swapChainImageFormat_,
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
 
-        VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-            .vertexBindingDescriptionCount = 0,
-            .vertexAttributeDescriptionCount = 0
-        };
+        if(depthFormat_ != VK_FORMAT_UNDEFINED)
+            create(depthAttachment_, depthFormat_, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT);
+    }
 
-        VkPipelineInputAssemblyStateCreateInfo inputAssembly = {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-            .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-            .primitiveRestartEnable = VK_FALSE
-        };
+    // what lazily allocated memory saved over regular allocations of the same images
+    void logTransientAttachmentMemory() {
+        VkDeviceSize size = 0, committed = 0;
+        bool lazy = false;
 
-        VkViewport viewport = {
-            .x = 0.0F,
-            .y = 0.0F,
-            .width = (float)swapChainExtent_.width,
-            .height = (float)swapChainExtent_.height,
-            .minDepth = 0.0F,
-            .maxDepth = 1.0F
-        };
+        for(auto attachment : { &msaaColorAttachment_, &depthAttachment_ }) {
+            if(!attachment->image)
+                continue;
 
-        VkRect2D scissor = {
-            .offset = { 0, 0 },
-            .extent = swapChainExtent_
+            const auto & memory = attachment->image.memory();
+            size += memory.size;
+            committed += allocator_.committedBytes(memory);
+            lazy |= allocator_.isLazilyAllocated(memory);
+        }
+
+        if(size == 0)
+            return;
+
+        constexpr double MiB = 1024.0 * 1024.0;
+        std::cout << "Transient attachments: " << size / MiB << " MiB";
+        if(lazy)
+            std::cout << ", " << committed / MiB << " MiB committed (lazily allocated, " << (size - committed) / MiB << " MiB saved)\n";
+        else
+            std::cout << " (no lazily allocated memory, nothing saved)\n";
+    }
+
+    void createRenderPass(VkFormat _colorFormat) {
+        renderPass_ = pipelineStates_.renderPass({
+            .colorFormat = _colorFormat,
+            .depthFormat = depthFormat_,
+            .samples = sampleCnt_,
+            // headless targets are only ever read back, scene images go on to the post-process passes
+            .finalLayout = options_.postProcess ? PostProcess::SCENE_FINAL_LAYOUT
+                : options_.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+        });
+    }
+
+    void createDescriptorSetLayout() {
+        // a set per frame slot, see updateBindless()
+        bindless_.init(device_, deviceCaps_.properties12, framesInFlight_);
+
+        VkDescriptorSetLayoutBinding frameBinding = {
+            .binding = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT
         };
 
-        VkPipelineViewportStateCreateInfo viewportState = {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-            .viewportCount = 1,
-            .pViewports = &viewport,
-            .scissorCount = 1,
-            .pScissors = &scissor
+        VkDescriptorSetLayoutCreateInfo frameLayoutInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .bindingCount = 1,
+            .pBindings = &frameBinding
         };
 
-        VkPipelineRasterizationStateCreateInfo rasterizer = {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-            .depthClampEnable = VK_FALSE,
-            .rasterizerDiscardEnable = VK_FALSE,
-            .polygonMode = VK_POLYGON_MODE_FILL,
-            .lineWidth = 1.0F,
-            .cullMode = VK_CULL_MODE_BACK_BIT,
-            .frontFace = VK_FRONT_FACE_CLOCKWISE,
-            .depthBiasEnable = VK_FALSE
+        if(vkCreateDescriptorSetLayout(device_, &frameLayoutInfo, nullptr, &frameSetLayout_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create frame descriptor set layout");
+    }
+
+    void createCullPipeline() {
+        VkDescriptorSetLayoutBinding bindings[3];
+        for(uint32_t i = 0; i< 3; ++i) {
+            // instances, draw commands, draw count
+            bindings[i] = {
+                .binding = i,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+            };
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .bindingCount = std::extent_v<decltype(bindings)>,
+            .pBindings = bindings
         };
 
-        VkPipelineMultisampleStateCreateInfo multiSampling = {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-            .sampleShadingEnable = VK_FALSE,
-            .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT
+        if(vkCreateDescriptorSetLayout(device_, &layoutInfo, nullptr, &cullSetLayout_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create cull descriptor set layout");
+
+        // instance count, index count, bounding radius
+        VkPushConstantRange pushConstantRange = {
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .offset = 0,
+            .size = 3 * sizeof(uint32_t)
         };
 
-        VkPipelineColorBlendAttachmentState colorBlendAttachment = {
-            .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
-            .blendEnable = VK_FALSE
+        cullPipelineLayout_ = pipelineStates_.layout({
+            .setLayouts = { cullSetLayout_ },
+            .pushConstantRanges = { pushConstantRange }
+        });
+
+        VkShaderModule cullShaderMod = createShaderModule("10_cull.comp");
+
+        VkComputePipelineCreateInfo pipelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = cullShaderMod,
+                .pName = "main"
+            },
+            .layout = cullPipelineLayout_
         };
 
-        VkPipelineColorBlendStateCreateInfo colorBlending = {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
-            .logicOpEnable = VK_FALSE,
-            .logicOp = VK_LOGIC_OP_COPY,
-            .attachmentCount = 1,
-            .pAttachments = &colorBlendAttachment,
-            .blendConstants = { 0.0F, 0.0F, 0.0F, 0.0F }
+        if(vkCreateComputePipelines(device_, pipelineCache_, 1, &pipelineInfo, nullptr, &cullPipeline_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create cull pipeline");
+
+        vkDestroyShaderModule(device_, cullShaderMod, nullptr);
+    }
+
+    void createPipelineCache() {
+        std::vector<char> initialData;
+
+        std::ifstream file(options_.pipelineCachePath, std::ios::ate | std::ios::binary);
+        if(file.is_open()) {
+            initialData.resize((std::size_t)file.tellg());
+            file.seekg(0);
+            file.read(initialData.data(), initialData.size());
+        }
+
+        if(!initialData.empty() && !isPipelineCacheCompatible(initialData)) {
+            std::cout << "Discarding stale pipeline cache(\"" << options_.pipelineCachePath << "\")\n";
+            initialData.clear();
+        }
+
+        VkPipelineCacheCreateInfo cacheInfo = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+            .initialDataSize = initialData.size(),
+            .pInitialData = initialData.empty() ? nullptr : initialData.data()
         };
 
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-            .setLayoutCount = 0,
-            .pushConstantRangeCount = 0
+        if(vkCreatePipelineCache(device_, &cacheInfo, nullptr, &pipelineCache_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create pipeline cache");
+
+        pipelineCacheWarm_ = !initialData.empty();
+        if(pipelineCacheWarm_)
+            std::cout << "Loaded pipeline cache(" << initialData.size() << " bytes)\n";
+    }
+
+    // the driver would reject a foreign blob too, but only after parsing it
+    bool isPipelineCacheCompatible(const std::vector<char> & _data) noexcept {
+        VkPipelineCacheHeaderVersionOne header;
+        if(_data.size() < sizeof(header))
+            return false;
+        std::memcpy(&header, _data.data(), sizeof(header));
+
+        const VkPhysicalDeviceProperties & props = deviceCaps_.properties;
+
+        return header.headerSize >= sizeof(header)
+            && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+            && header.vendorID == props.vendorID
+            && header.deviceID == props.deviceID
+            && std::memcmp(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
+
+    void savePipelineCache() {
+        size_t dataSz = 0;
+        if(vkGetPipelineCacheData(device_, pipelineCache_, &dataSz, nullptr) != VK_SUCCESS || dataSz == 0)
+            return;
+
+        std::vector<char> data(dataSz);
+        if(vkGetPipelineCacheData(device_, pipelineCache_, &dataSz, data.data()) != VK_SUCCESS)
+            return;
+
+        // write aside and rename over, so a crash never leaves a torn cache behind
+        auto tmpPath = options_.pipelineCachePath + ".tmp";
+        {
+            std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+            if(!file.is_open()) {
+                std::cerr << "Failed to write pipeline cache(\"" << tmpPath << "\")\n";
+                return;
+            }
+            file.write(data.data(), dataSz);
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tmpPath, options_.pipelineCachePath, ec);
+        if(ec)
+            std::cerr << "Failed to replace pipeline cache: " << ec.message() << "\n";
+        else if(pipelineCreationFeedback_)
+            std::cout << "Saved pipeline cache(" << dataSz << " bytes, "
+                << pipelineCacheHits_ << " hits, " << pipelineCacheMisses_ << " misses)\n";
+        else
+            std::cout << "Saved pipeline cache(" << dataSz << " bytes)\n";
+    }
+
+    void initPipelineCompiler() {
+        uint32_t threadCnt = options_.pipelineThreadCnt;
+        if(threadCnt == 0)
+            threadCnt = std::clamp(std::thread::hardware_concurrency() / 2, 1U, 4U);
+
+        pipelineCompiler_.init(device_, pipelineCache_,
+            [this](std::string_view _name) { return createShaderModule(_name); }, threadCnt, pipelineCreationFeedback_);
+        pipelineStates_.init(device_, pipelineCompiler_);
+    }
+
+    // the first lookup queues the compile, installPipelines() picks the pipeline up
+    void createGraphicsPipeline() {
+        VkPushConstantRange drawConstantsRange = {
+            .stageFlags = DRAW_CONSTANTS_STAGES,
+            .offset = 0,
+            .size = sizeof(DrawConstants)
         };
 
-        if(vkCreatePipelineLayout(device_, &pipelineLayoutInfo, nullptr, &pipelineLayout_) != VK_SUCCESS)
-            throw std::runtime_error("Failed to create pipeline layout");
-        
-        VkGraphicsPipelineCreateInfo pipelineInfo = {
-            .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-            .stageCount = std::extent_v<decltype(shaderStages)>,
-            .pStages = shaderStages,
-            .pVertexInputState = &vertexInputInfo,
-            .pInputAssemblyState = &inputAssembly,
-            .pViewportState = &viewportState,
-            .pRasterizationState = &rasterizer,
-            .pMultisampleState = &multiSampling,
-            .pColorBlendState = &colorBlending,
+        pipelineLayout_ = pipelineStates_.layout({
+            .setLayouts = { bindless_.layout(), frameSetLayout_ },
+            .pushConstantRanges = { drawConstantsRange }
+        });
+
+        auto bindingDescription = Vertex::getBindingDescription();
+        auto attributeDescriptions = Vertex::getAttributeDescriptions();
+
+        graphicsPipelineDesc_ = {
+            .vertexShader = "09_shader_base.vert",
+            .fragmentShader = "09_shader_base.frag",
+            .vertexBindings = { bindingDescription },
+            .vertexAttributes = { attributeDescriptions.begin(), attributeDescriptions.end() },
+            .samples = sampleCnt_,
+            .depthTest = depthFormat_ != VK_FORMAT_UNDEFINED,
             .layout = pipelineLayout_,
-            .renderPass = renderPass_,
-            .subpass = 0,
-            .basePipelineHandle = VK_NULL_HANDLE
+            .renderPass = renderPass_
         };
+        graphicsPipeline_ = pipelineStates_.pipeline(graphicsPipelineDesc_);
+    }
+
+    // takes the pipelines the compiler finished and looks the frame's pipeline up again, never blocks
+    void installPipelines() {
+        for(const auto & result : pipelineStates_.update()) {
+            // the frame goes on without the draws that need it
+            if(result.pipeline == VK_NULL_HANDLE) {
+                std::cerr << result.error << "\n";
+                continue;
+            }
 
-        if(vkCreateGraphicsPipelines(device_, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline_) != VK_SUCCESS)
-            throw std::runtime_error("Failed to create graphics pipeline");
+            std::cout << "Created graphics pipeline in " << result.compileMs << " ms (";
+            if(result.cacheHit) {
+                ++(*result.cacheHit ? pipelineCacheHits_ : pipelineCacheMisses_);
+                std::cout << (*result.cacheHit ? "cache hit, " : "cache miss, ");
+            }
+            std::cout << (pipelineCacheWarm_ ? "warm cache" : "cold cache") << ")\n";
+        }
 
-        vkDestroyShaderModule(device_, fragShaderMod, nullptr);
-        vkDestroyShaderModule(device_, vertShaderMod, nullptr);
+        graphicsPipeline_ = pipelineStates_.pipeline(graphicsPipelineDesc_);
     }
 
+    // post-processing: one per frame slot over its scene image, see frameBuffer()
     void createFrameBuffers() {
-        swapChainFrameBuffers_.resize(swapChainImageViews_.size());
+        std::vector<VkImageView> colorViews;
+        if(options_.postProcess) {
+            for(auto i = 0; i< framesInFlight_; ++i)
+                colorViews.push_back(post_.sceneView(i));
+        } else {
+            for(const auto & view : swapChainImageViews_)
+                colorViews.push_back(view.get());
+        }
 
-        for(auto i = 0; i< swapChainImageViews_.size(); ++i) {
-            VkImageView attachments[] = {
-                swapChainImageViews_[i]
-            };
+        swapChainFrameBuffers_.clear();
+
+        for(auto i = 0; i< colorViews.size(); ++i) {
+            // in the order of RenderPassDesc: color, depth, resolve
+            std::vector<VkImageView> attachments;
+            if(msaaColorAttachment_.view)
+                attachments.push_back(msaaColorAttachment_.view.get());
+            else
+                attachments.push_back(colorViews[i]);
+
+            if(depthAttachment_.view)
+                attachments.push_back(depthAttachment_.view.get());
+
+            if(msaaColorAttachment_.view)
+                attachments.push_back(colorViews[i]);
 
             VkFramebufferCreateInfo frameBufferInfo = {
                 .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
                 .renderPass = renderPass_,
-                .attachmentCount = 1,
-                .pAttachments = attachments,
+                .attachmentCount = static_cast<uint32_t>(attachments.size()),
+                .pAttachments = attachments.data(),
                 .width = swapChainExtent_.width,
                 .height = swapChainExtent_.height,
                 .layers = 1
             };
 
-            if(vkCreateFramebuffer(device_, &frameBufferInfo, nullptr, &swapChainFrameBuffers_[i]) != VK_SUCCESS)
+            VkFramebuffer frameBuffer;
+            if(vkCreateFramebuffer(device_, &frameBufferInfo, nullptr, &frameBuffer) != VK_SUCCESS)
                 throw std::runtime_error("Failed to create frame buffer(" + std::to_string(i) + ")");
+            swapChainFrameBuffers_.emplace_back(device_, frameBuffer);
         }
     }
 
     void createCommandPool() {
-        QueueFamilyIndices queryFamilyIndices = findQueueFamilies(physicalDevice_);
-
         VkCommandPoolCreateInfo poolInfo = {
             .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-            .queueFamilyIndex = queryFamilyIndices.graphicsFamily.value()
+            .queueFamilyIndex = deviceCaps_.queueFamilyIndices.graphicsFamily.value()
         };
 
         if(vkCreateCommandPool(device_, &poolInfo, nullptr, &commandPool_) != VK_SUCCESS)
             throw std::runtime_error("Failed to create command pool");
     }
 
+    void createQueryPools() {
+        // a slot per frame in flight
+        gpuProfiler_.init(device_, deviceCaps_, deviceCaps_.queueFamilyIndices.graphicsFamily.value(),
+            framesInFlight_, hasPipelineStatistics());
+    }
+
     void createCommandBuffers() {
-        commandBuffers_.resize(swapChainFrameBuffers_.size());
+        uint32_t threadCnt = options_.recordThreadCnt != 0 ? options_.recordThreadCnt : std::thread::hardware_concurrency();
+        recordJobs_ = std::make_unique<JobSystem>(threadCnt);
 
-        VkCommandBufferAllocateInfo allocInfo = {
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-            .commandPool = commandPool_,
-            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-            .commandBufferCount = (uint32_t)commandBuffers_.size()
-        };
+        uint32_t graphicsFamily = deviceCaps_.queueFamilyIndices.graphicsFamily.value();
 
-        if(vkAllocateCommandBuffers(device_, &allocInfo, commandBuffers_.data()) != VK_SUCCESS)
-            throw std::runtime_error("Failed to allocate command buffers");
+        VkCommandPoolCreateInfo poolInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+            .queueFamilyIndex = graphicsFamily
+        };
 
-        for(auto i = 0; i< commandBuffers_.size(); ++i) {
-            VkCommandBufferBeginInfo beginInfo = {
-                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-            };
+        frameCommands_.resize(framesInFlight_);
+        for(auto & frame : frameCommands_) {
+            if(vkCreateCommandPool(device_, &poolInfo, nullptr, &frame.primaryPool) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create frame command pool");
 
-            if(vkBeginCommandBuffer(commandBuffers_[i], &beginInfo) != VK_SUCCESS)
-                throw std::runtime_error("Failed to begin command buffer(" + std::to_string(i) + ")");
-            
-            VkRenderPassBeginInfo renderPassInfo = {
-                .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-                .renderPass = renderPass_,
-                .framebuffer = swapChainFrameBuffers_[i],
-                .renderArea.offset = { 0, 0 },
-                .renderArea.extent = swapChainExtent_
+            VkCommandBufferAllocateInfo allocInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = frame.primaryPool,
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = 1
             };
 
-            VkClearValue clearColor = { 0.0F, 0.0F, 0.0F, 1.0F };
+            if(vkAllocateCommandBuffers(device_, &allocInfo, &frame.primary) != VK_SUCCESS)
+                throw std::runtime_error("Failed to allocate command buffers");
 
-            renderPassInfo.clearValueCount = 1;
-            renderPassInfo.pClearValues = &clearColor;
+            frame.threadPools.resize(recordJobs_->threadCnt());
+            frame.threadBuffers.resize(recordJobs_->threadCnt());
+            frame.threadBuffersUsed.assign(recordJobs_->threadCnt(), 0);
 
-            vkCmdBeginRenderPass(commandBuffers_[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+            for(auto & pool : frame.threadPools) {
+                if(vkCreateCommandPool(device_, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+                    throw std::runtime_error("Failed to create recording thread command pool");
+            }
+        }
+    }
 
-            vkCmdBindPipeline(commandBuffers_[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline_);
+    // the frame's previous submission must have completed
+    void resetFrameCommands(FrameCommands & _frame) {
+        vkResetCommandPool(device_, _frame.primaryPool, 0);
 
-            vkCmdDraw(commandBuffers_[i], 3, 1, 0, 0);
+        for(auto i = 0; i< _frame.threadPools.size(); ++i) {
+            vkResetCommandPool(device_, _frame.threadPools[i], 0);
+            _frame.threadBuffersUsed[i] = 0;
+        }
+    }
 
-            vkCmdEndRenderPass(commandBuffers_[i]);
+    // draws [_firstDraw, _firstDraw + _drawCnt) of _totalDrawCnt into a secondary buffer from the thread's pool
+    VkCommandBuffer recordSecondary(FrameCommands & _frame, uint32_t _thread, VkFramebuffer _frameBuffer,
+        const FrameInstances & _instances, uint32_t _firstDraw, uint32_t _drawCnt, uint32_t _totalDrawCnt) {
+        auto & buffers = _frame.threadBuffers[_thread];
+        auto & used = _frame.threadBuffersUsed[_thread];
+
+        // buffers go back to the initial state with their pool, so keep and reuse them
+        if(used == buffers.size()) {
+            VkCommandBufferAllocateInfo allocInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = _frame.threadPools[_thread],
+                .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+                .commandBufferCount = 1
+            };
 
-            if(vkEndCommandBuffer(commandBuffers_[i]) != VK_SUCCESS)
-                throw std::runtime_error("Failed to end command buffer");
+            VkCommandBuffer buffer;
+            if(vkAllocateCommandBuffers(device_, &allocInfo, &buffer) != VK_SUCCESS)
+                throw std::runtime_error("Failed to allocate secondary command buffer");
+            buffers.push_back(buffer);
         }
-    }
 
-    void createSyncObjects() {
-        imageAvailableSemaphores_.resize(MAX_FRAMES_IN_FLIGHT);
-        renderFinishedSemaphores_.resize(MAX_FRAMES_IN_FLIGHT);
-        inFlightFences_.resize(MAX_FRAMES_IN_FLIGHT);
-        imagesInFlight_.resize(swapChainImages_.size(), VK_NULL_HANDLE);
+        VkCommandBuffer cmdBuf = buffers[used++];
 
-        VkSemaphoreCreateInfo semaphoreInfo = {
-            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        VkCommandBufferInheritanceInfo inheritanceInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+            .renderPass = renderPass_,
+            .subpass = 0,
+            .framebuffer = _frameBuffer,
+            // the primary has the profiler's statistics query active around the render pass
+            .pipelineStatistics = gpuProfiler_.statisticsFlags()
         };
 
-        VkFenceCreateInfo fenceInfo = {
-            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-            .flags = VK_FENCE_CREATE_SIGNALED_BIT
+        VkCommandBufferBeginInfo beginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+            .pInheritanceInfo = &inheritanceInfo
         };
 
-        for(auto i = 0; i< MAX_FRAMES_IN_FLIGHT; ++i) {
-            if( vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &imageAvailableSemaphores_[i]) != VK_SUCCESS ||
-                vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &renderFinishedSemaphores_[i]) != VK_SUCCESS ||
-                vkCreateFence(device_, &fenceInfo, nullptr, &inFlightFences_[i]) != VK_SUCCESS)
-                throw std::runtime_error("Failed to create sync objects");
-        }
-    }
+        if(vkBeginCommandBuffer(cmdBuf, &beginInfo) != VK_SUCCESS)
+            throw std::runtime_error("Failed to begin secondary command buffer");
 
-    void drawFrame() {
-        vkWaitForFences(device_, 1, &inFlightFences_[currentFrame_], VK_TRUE, UINT64_MAX);
+        vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline_);
 
-        uint32_t imageIndex;
-        vkAcquireNextImageKHR(device_, swapChain_, UINT64_MAX, imageAvailableSemaphores_[currentFrame_], VK_NULL_HANDLE, &imageIndex);
+        VkViewport viewport = {
+            .x = 0.0F,
+            .y = 0.0F,
+            .width = (float)swapChainExtent_.width,
+            .height = (float)swapChainExtent_.height,
+            .minDepth = 0.0F,
+            .maxDepth = 1.0F
+        };
+        vkCmdSetViewport(cmdBuf, 0, 1, &viewport);
 
-        if(imagesInFlight_[imageIndex] != VK_NULL_HANDLE)
-            vkWaitForFences(device_, 1, &imagesInFlight_[imageIndex], VK_TRUE, UINT64_MAX);
-        
-        imagesInFlight_[imageIndex] = inFlightFences_[currentFrame_];
+        VkRect2D scissor = {
+            .offset = { 0, 0 },
+            .extent = swapChainExtent_
+        };
+        vkCmdSetScissor(cmdBuf, 0, 1, &scissor);
 
-        VkSubmitInfo submitInfo = {
-            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        VkDescriptorSet sets[] = { bindlessSet_, frameSet_ };
+        vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_,
+            0, std::extent_v<decltype(sets)>, sets, 1, &frameUniformOffset_);
+
+        DrawConstants drawConstants = {
+            .tint = { 1.0F, 1.0F, 1.0F, 1.0F },
+            .instanceBuffer = _instances.bindlessIndex,
+            .texture = BindlessTable::NONE
         };
 
-        VkSemaphore waitSemaphores[] = { imageAvailableSemaphores_[currentFrame_] };
+        VkDeviceSize vertexOffset = 0;
+        vkCmdBindVertexBuffers(cmdBuf, 0, 1, &mesh_.vertexBuffer, &vertexOffset);
+        vkCmdBindIndexBuffer(cmdBuf, mesh_.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+        // the cull pass wrote the draws, a single indirect count draw issues all of them
+        if(gpuCulling_) {
+            drawConstants.texture = drawTexture(0);
+            vkCmdPushConstants(cmdBuf, pipelineLayout_, DRAW_CONSTANTS_STAGES, 0, sizeof(drawConstants), &drawConstants);
+            vkCmdDrawIndexedIndirectCount(cmdBuf, _instances.drawBuffer.get(), 0, _instances.drawCountBuffer.get(), 0,
+                instanceScene_.size(), sizeof(VkDrawIndexedIndirectCommand));
+            _drawCnt = 0;
+        }
 
-        VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+        // each draw takes its share of the instances, with fewer instances than draws every draw repeats all of them
+        uint32_t instanceCnt = _instances.visibleCnt;
+        for(uint32_t i = _firstDraw; i< _firstDraw + _drawCnt; ++i) {
+            uint32_t first = 0, last = instanceCnt;
+            if(instanceCnt >= _totalDrawCnt) {
+                first = uint64_t(instanceCnt) * i / _totalDrawCnt;
+                last = uint64_t(instanceCnt) * (i + 1) / _totalDrawCnt;
+            }
 
-        submitInfo.waitSemaphoreCount = std::extent_v<decltype(waitStages)>;
-        submitInfo.pWaitSemaphores = waitSemaphores;
-        submitInfo.pWaitDstStageMask = waitStages;
+            if(last > first) {
+                drawConstants.texture = drawTexture(i);
+                vkCmdPushConstants(cmdBuf, pipelineLayout_, DRAW_CONSTANTS_STAGES, 0, sizeof(drawConstants), &drawConstants);
+                vkCmdDrawIndexed(cmdBuf, mesh_.indexCnt, last - first, 0, 0, first);
+            }
+        }
 
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffers_[imageIndex];
+        if(vkEndCommandBuffer(cmdBuf) != VK_SUCCESS)
+            throw std::runtime_error("Failed to end secondary command buffer");
 
-        VkSemaphore signalSemaphores[] = { renderFinishedSemaphores_[currentFrame_] };
-        submitInfo.signalSemaphoreCount = std::extent_v<decltype(signalSemaphores)>;
-        submitInfo.pSignalSemaphores = signalSemaphores;
+        return cmdBuf;
+    }
 
-        vkResetFences(device_, 1, &inFlightFences_[currentFrame_]);
+    // draws cycle through the scene textures, NONE while a texture has no resident level yet
+    uint32_t drawTexture(uint32_t _draw) const noexcept {
+        if(sceneTextures_.empty())
+            return BindlessTable::NONE;
+        return sceneTextures_[_draw % sceneTextures_.size()].bindlessIndex;
+    }
 
-        if(vkQueueSubmit(graphicsQueue_, 1, &submitInfo, inFlightFences_[currentFrame_]) != VK_SUCCESS)
-            throw std::runtime_error("Failed to submit draw command buffer");
+    // records _drawCnt draws on the recording threads, one contiguous chunk per job
+    std::vector<VkCommandBuffer> recordSecondaries(FrameCommands & _frame, VkFramebuffer _frameBuffer,
+        const FrameInstances & _instances, uint32_t _drawCnt, JobSystem & _jobs) {
+        // a few chunks per thread evens out uneven progress
+        uint32_t jobCnt = std::min(_drawCnt, _jobs.threadCnt() * 4);
+        std::vector<VkCommandBuffer> secondaries(jobCnt);
 
-        VkPresentInfoKHR presentInfo = {
-            .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+        _jobs.run(jobCnt, [&](uint32_t _job, uint32_t _thread) {
+            uint32_t first = uint64_t(_drawCnt) * _job / jobCnt;
+            uint32_t last = uint64_t(_drawCnt) * (_job + 1) / jobCnt;
 
-            .waitSemaphoreCount = 1,
-            .pWaitSemaphores = signalSemaphores
-        };
+            secondaries[_job] = recordSecondary(_frame, _thread, _frameBuffer, _instances, first, last - first, _drawCnt);
+        });
 
-        VkSwapchainKHR swapChains[] = { swapChain_ };
+        return secondaries;
+    }
 
-        presentInfo.swapchainCount = std::extent_v<decltype(swapChains)>;
-        presentInfo.pSwapchains = swapChains;
+    void recordFrame(uint32_t _frame, uint32_t _imageIndex) {
+        auto & frame = frameCommands_[_frame];
+        resetFrameCommands(frame);
 
-        presentInfo.pImageIndices = &imageIndex;
+        auto start = std::chrono::steady_clock::now();
 
-        vkQueuePresentKHR(presentQueue_, &presentInfo);
+        // just clear until the mesh has been streamed in and its pipeline compiled
+        bool meshReady = uploader_.isReady(mesh_.uploadTicket) && graphicsPipeline_ != VK_NULL_HANDLE;
+        // with gpu culling the single secondary only holds the indirect count draw
+        uint32_t drawCnt = meshReady ? (gpuCulling_ ? 1 : options_.drawCnt) : 0;
 
-        currentFrame_ = (currentFrame_ + 1) % MAX_FRAMES_IN_FLIGHT;
-    }
+        auto & instances = frameInstances_[_frame];
+        VkFramebuffer frameBuffer = swapChainFrameBuffers_[options_.postProcess ? _frame : _imageIndex].get();
+        auto secondaries = recordSecondaries(frame, frameBuffer, instances, drawCnt, *recordJobs_);
 
-    VkShaderModule createShaderModule(const std::vector<char> & code) {
-        VkShaderModuleCreateInfo createInfo = {
-            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-            .codeSize = code.size(), // * sizeof(uint32_t), // idk why not
-            .pCode = reinterpret_cast<const uint32_t *>(code.data())
+        VkCommandBufferBeginInfo beginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
         };
 
-        VkShaderModule shaderModule;
-        if(vkCreateShaderModule(device_, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
-            throw std::runtime_error("Failed to create shader module");
-        
-        return shaderModule;
-    }
+        if(vkBeginCommandBuffer(frame.primary, &beginInfo) != VK_SUCCESS)
+            throw std::runtime_error("Failed to begin command buffer(" + std::to_string(_frame) + ")");
+
+        uploader_.cmdAcquire(frame.primary, _frame);
+        textures_.cmdStream(frame.primary, _frame);
+
+        gpuProfiler_.cmdBegin(frame.primary, _frame);
+
+        if(gpuCulling_ && meshReady)
+            recordCulling(frame.primary, instances);
+        
+        VkRenderPassBeginInfo renderPassInfo = {
+            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+            .renderPass = renderPass_,
+            .framebuffer = frameBuffer,
+            .renderArea.offset = { 0, 0 },
+            .renderArea.extent = swapChainExtent_
+        };
+
+        // by attachment index, the resolve target isn't cleared
+        VkClearValue clearValues[] = {
+            { .color = {{ 0.0F, 0.0F, 0.0F, 1.0F }} },
+            { .depthStencil = { 1.0F, 0 } }
+        };
+
+        renderPassInfo.clearValueCount = depthFormat_ != VK_FORMAT_UNDEFINED ? 2 : 1;
+        renderPassInfo.pClearValues = clearValues;
+
+        vkCmdBeginRenderPass(frame.primary, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+        if(!secondaries.empty())
+            vkCmdExecuteCommands(frame.primary, secondaries.size(), secondaries.data());
+
+        vkCmdEndRenderPass(frame.primary);
+
+        // inline passes count towards the frame's GPU time, async ones run on the compute queue
+        if(options_.postProcess) {
+            postWait_ = post_.cmdRecord(frame.primary, _frame, swapChainImages_[_imageIndex],
+                options_.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+        }
+
+        gpuProfiler_.cmdEnd(frame.primary, _frame);
+
+        // after the profiled span, so GPU frame times stay comparable with capture off
+        if(options_.capturePath) {
+            frameCapture_.cmdCapture(frame.primary, swapChainImages_[_imageIndex],
+                options_.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                swapChainImageFormat_, swapChainExtent_);
+        }
+
+        if(vkEndCommandBuffer(frame.primary) != VK_SUCCESS)
+            throw std::runtime_error("Failed to end command buffer");
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        recordMs_ = elapsed.count();
+    }
+
+    // recording throughput vs. thread count, nothing is submitted
+    void benchmarkRecording(uint32_t _drawCnt) {
+        constexpr auto ITERATIONS = 20;
+
+        uint32_t maxThreadCnt = recordJobs_->threadCnt();
+        auto & frame = frameCommands_[0];
+
+        std::cout << "Recording " << _drawCnt << " draws, best of " << ITERATIONS << " runs\n";
+
+        for(uint32_t threadCnt = 1; ; threadCnt = std::min(threadCnt * 2, maxThreadCnt)) {
+            // each worker of this system maps onto the frame's first threadCnt pools
+            JobSystem jobs(threadCnt);
+
+            double bestMs = std::numeric_limits<double>::max();
+            for(auto i = 0; i< ITERATIONS; ++i) {
+                auto start = std::chrono::steady_clock::now();
+
+                resetFrameCommands(frame);
+                recordSecondaries(frame, swapChainFrameBuffers_[0].get(), frameInstances_[0], _drawCnt, jobs);
+
+                std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+                bestMs = std::min(bestMs, elapsed.count());
+            }
+
+            std::cout << "  " << threadCnt << " thread(s): " << bestMs << " ms, "
+                << (_drawCnt / bestMs) << " draws/ms\n";
+
+            if(threadCnt == maxThreadCnt)
+                break;
+        }
+
+        resetFrameCommands(frame);
+    }
+
+    // y = a * x + y checked against the CPU, headless this runs on lavapipe in CI.
+    // z shares no written buffer with the passes over y, so only the second pass over y waits on a barrier
+    void testCompute(uint32_t _elementCnt) {
+        struct SaxpyParams {
+            float a;
+            uint32_t count;
+        };
+
+        auto saxpy = compute_.createPipeline(loadShaderCode("11_saxpy.comp"), 2, sizeof(SaxpyParams));
+
+        std::vector<float> x(_elementCnt), y(_elementCnt, 1.0F);
+        for(uint32_t i = 0; i< _elementCnt; ++i)
+            x[i] = float(i % 1024);
+
+        VkDeviceSize bytes = sizeof(float) * _elementCnt;
+        auto xBuffer = compute_.createBuffer(bytes, x.data());
+        auto yBuffer = compute_.createBuffer(bytes, y.data());
+        auto zBuffer = compute_.createBuffer(bytes, y.data());
+
+        uint32_t groupCnt = ComputeContext::groupCnt(_elementCnt, 64);
+        SaxpyParams first = { .a = 2.0F, .count = _elementCnt }, second = { .a = 0.5F, .count = _elementCnt };
+
+        auto start = std::chrono::steady_clock::now();
+
+        compute_.dispatch(saxpy, { { .buffer = xBuffer.buffer }, { .buffer = yBuffer.buffer, .write = true } }, groupCnt, 1, 1, &first);
+        compute_.dispatch(saxpy, { { .buffer = xBuffer.buffer }, { .buffer = zBuffer.buffer, .write = true } }, groupCnt, 1, 1, &first);
+        compute_.dispatch(saxpy, { { .buffer = xBuffer.buffer }, { .buffer = yBuffer.buffer, .write = true } }, groupCnt, 1, 1, &second);
+
+        auto yResult = compute_.readBack<float>(yBuffer);
+        auto zResult = compute_.readBack<float>(zBuffer);
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        // small integers times powers of two, exact in float
+        uint32_t mismatchCnt = 0;
+        for(uint32_t i = 0; i< _elementCnt; ++i) {
+            if(yResult[i] != 1.0F + 2.5F * x[i] || zResult[i] != 1.0F + 2.0F * x[i])
+                ++mismatchCnt;
+        }
+
+        compute_.destroyBuffer(zBuffer);
+        compute_.destroyBuffer(yBuffer);
+        compute_.destroyBuffer(xBuffer);
+        compute_.destroyPipeline(saxpy);
+
+        std::cout << "Compute test: 3 saxpy dispatches over " << _elementCnt << " floats, "
+            << compute_.stats().barriers << " barrier(s), " << elapsed.count() << " ms incl. readback\n";
+
+        if(mismatchCnt != 0)
+            throw std::runtime_error("Compute test failed: " + std::to_string(mismatchCnt) + " mismatching elements");
+    }
+
+    // per-draw data through a uniform ring block and dynamic offset vs. push constants, recorded but never submitted
+    void benchmarkUniforms(uint32_t _drawCnt) {
+        constexpr auto ITERATIONS = 20;
+
+        auto alignment = deviceCaps_.properties.limits.minUniformBufferOffsetAlignment;
+
+        // a block per draw, as if every draw had its own FrameUniforms
+        UniformRing ring;
+        ring.init(device_, allocator_, alignment, 1, VkDeviceSize(_drawCnt) * std::max<VkDeviceSize>(sizeof(FrameUniforms), alignment));
+
+        // nothing is in flight, the offsets have to fit the set's buffer
+        vkDeviceWaitIdle(device_);
+        writeFrameSet(ring.buffer());
+
+        auto & frame = frameCommands_[0];
+        VkCommandBufferBeginInfo beginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+        };
+
+        auto measure = [&](auto && _perDraw) {
+            double bestMs = std::numeric_limits<double>::max();
+            for(auto i = 0; i< ITERATIONS; ++i) {
+                resetFrameCommands(frame);
+                vkBeginCommandBuffer(frame.primary, &beginInfo);
+
+                auto start = std::chrono::steady_clock::now();
+
+                for(uint32_t draw = 0; draw< _drawCnt; ++draw)
+                    _perDraw(draw);
+
+                std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+                bestMs = std::min(bestMs, elapsed.count());
+
+                vkEndCommandBuffer(frame.primary);
+            }
+            return bestMs * 1e6 / _drawCnt;
+        };
+
+        std::cout << "Per-draw update of " << _drawCnt << " draws, best of " << ITERATIONS << " runs\n";
+
+        FrameUniforms uniforms = { .viewScale = { 1.0F, 1.0F } };
+        double ringNs = measure([&](uint32_t _draw) {
+            if(_draw == 0)
+                ring.begin(0);
+
+            uniforms.time = float(_draw);
+            uint32_t offset = ring.push(uniforms);
+            vkCmdBindDescriptorSets(frame.primary, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 1, 1, &frameSet_, 1, &offset);
+        });
+        std::cout << "  uniform ring + dynamic offset (" << sizeof(FrameUniforms) << " bytes): " << ringNs << " ns/draw\n";
+
+        DrawConstants drawConstants = {};
+        double pushNs = measure([&](uint32_t _draw) {
+            drawConstants.tint[0] = float(_draw);
+            vkCmdPushConstants(frame.primary, pipelineLayout_, DRAW_CONSTANTS_STAGES, 0, sizeof(drawConstants), &drawConstants);
+        });
+        std::cout << "  push constants (" << sizeof(DrawConstants) << " bytes): " << pushNs << " ns/draw\n";
+
+        resetFrameCommands(frame);
+        writeFrameSet(uniformRing_.buffer());
+        ring.destroy();
+    }
+
+    // where the CPU -> GPU instance data path saturates
+    void benchmarkInstances() {
+        // the mesh upload and instance buffer growth land in the warm-up frames
+        const uint32_t WARMUP_FRAMES = 2 * framesInFlight_;
+        constexpr double MiB = 1024.0 * 1024.0;
+
+        uint32_t frameCnt = options_.frameCnt != 0 ? std::min<uint32_t>(options_.frameCnt, GpuProfiler::HISTORY_SIZE) : 200;
+
+        std::cout << "Instance sweep, " << frameCnt << " frames each, " << (gpuCulling_ ? "GPU" : "CPU") << " driven draws\n";
+
+        for(uint32_t instanceCnt = 1024; instanceCnt<= (1U << 20); instanceCnt *= 4) {
+            instanceScene_.resize(instanceCnt);
+
+            double updateMs = 0.0, recordMs = 0.0;
+            uint64_t visibleCnt = 0;
+            for(uint32_t i = 0; i< WARMUP_FRAMES + frameCnt; ++i) {
+                if(!options_.headless) {
+                    glfwPollEvents();
+                    // cleanup() expects an idle device
+                    if(glfwWindowShouldClose(window_)) {
+                        vkDeviceWaitIdle(device_);
+                        return;
+                    }
+                }
+
+                // only the measured frames in the GPU stats
+                if(i == WARMUP_FRAMES) {
+                    vkDeviceWaitIdle(device_);
+                    for(uint32_t slot = 0; slot< framesInFlight_; ++slot)
+                        gpuProfiler_.collect(slot);
+                    gpuProfiler_.reset();
+                }
+
+                drawFrame();
+
+                if(i >= WARMUP_FRAMES) {
+                    updateMs += instanceUpdateMs_;
+                    recordMs += recordMs_;
+                    visibleCnt += instanceVisibleCnt_;
+                }
+            }
+
+            vkDeviceWaitIdle(device_);
+            for(uint32_t slot = 0; slot< framesInFlight_; ++slot)
+                gpuProfiler_.collect(slot);
+
+            auto stats = gpuProfiler_.stats();
+            std::cout << "  " << instanceCnt << " instances (" << visibleCnt / frameCnt << " visible): CPU update " << updateMs / frameCnt
+                << " ms, record " << recordMs / frameCnt << " ms, GPU "
+                << stats.avgMs << " ms avg / " << stats.p99Ms << " ms p99, "
+                << sizeof(InstanceGpu) * instanceCnt / MiB << " MiB/frame\n";
+        }
+    }
+
+    // frame time with the post-process passes inline on the graphics queue vs. on the compute queue,
+    // overlapping the next frame's rendering. Headless measures the GPU, windowed the present mode caps it
+    void benchmarkPost() {
+        const uint32_t WARMUP_FRAMES = 2 * framesInFlight_;
+
+        uint32_t frameCnt = options_.frameCnt != 0 ? std::min<uint32_t>(options_.frameCnt, GpuProfiler::HISTORY_SIZE) : 200;
+
+        std::cout << "Post-process, " << frameCnt << " frames each, blur radius " << options_.blurRadius << "\n";
+        if(!post_.asyncSupported())
+            std::cout << "  no separate compute queue or a single frame in flight, graphics queue only\n";
+
+        for(bool async : { false, true }) {
+            if(async && !post_.asyncSupported())
+                break;
+
+            vkDeviceWaitIdle(device_);
+            post_.setAsync(async);
+
+            auto start = std::chrono::steady_clock::now();
+            for(uint32_t i = 0; i< WARMUP_FRAMES + frameCnt; ++i) {
+                if(!options_.headless) {
+                    glfwPollEvents();
+                    // cleanup() expects an idle device, the compute queue may still be busy too
+                    if(glfwWindowShouldClose(window_)) {
+                        vkDeviceWaitIdle(device_);
+                        return;
+                    }
+                }
+
+                // only the measured frames in the GPU stats
+                if(i == WARMUP_FRAMES) {
+                    vkDeviceWaitIdle(device_);
+                    for(uint32_t slot = 0; slot< framesInFlight_; ++slot)
+                        gpuProfiler_.collect(slot);
+                    gpuProfiler_.reset();
+                    start = std::chrono::steady_clock::now();
+                }
+
+                drawFrame();
+            }
+
+            vkDeviceWaitIdle(device_);
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            for(uint32_t slot = 0; slot< framesInFlight_; ++slot)
+                gpuProfiler_.collect(slot);
+
+            auto stats = gpuProfiler_.stats();
+            std::cout << "  " << (async ? "compute" : "graphics") << " queue: " << elapsed.count() / frameCnt
+                << " ms/frame, graphics queue GPU " << stats.avgMs << " ms avg / " << stats.p99Ms << " ms p99\n";
+        }
+    }
+
+    void createSyncObjects() {
+        imageAvailableSemaphores_.resize(framesInFlight_);
+        renderFinishedSemaphores_.resize(framesInFlight_);
+        frameSlotValues_.assign(framesInFlight_, 0);
+
+        VkSemaphoreCreateInfo semaphoreInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        };
+
+        for(auto i = 0; i< framesInFlight_; ++i) {
+            if( vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &imageAvailableSemaphores_[i]) != VK_SUCCESS ||
+                vkCreateSemaphore(device_, &semaphoreInfo, nullptr, &renderFinishedSemaphores_[i]) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create sync objects");
+        }
+
+        VkSemaphoreTypeCreateInfo timelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0
+        };
+
+        VkSemaphoreCreateInfo timelineSemaphoreInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &timelineInfo
+        };
+
+        if(vkCreateSemaphore(device_, &timelineSemaphoreInfo, nullptr, &graphicsTimeline_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create graphics timeline semaphore");
+    }
+
+    // blocks until the graphics queue finished frame _value (0: returns right away), returns the time blocked
+    double waitForFrame(uint64_t _value) {
+        uint64_t completed;
+        vkGetSemaphoreCounterValue(device_, graphicsTimeline_, &completed);
+        if(completed >= _value)
+            return 0.0;
+
+        auto start = std::chrono::steady_clock::now();
+
+        VkSemaphoreWaitInfo waitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .semaphoreCount = 1,
+            .pSemaphores = &graphicsTimeline_,
+            .pValues = &_value
+        };
+
+        if(vkWaitSemaphores(device_, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+            throw std::runtime_error("Failed to wait for frame(" + std::to_string(_value) + ")");
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count();
+    }
+
+    void createStagingUploader() {
+        const QueueFamilyIndices & indices = deviceCaps_.queueFamilyIndices;
+        uint32_t graphicsFamily = indices.graphicsFamily.value();
+
+        // a slot per frame in flight, a slot's batch is done once its frame is
+        uploader_.init(device_, allocator_, indices.transferFamily.value_or(graphicsFamily), transferQueue_,
+            graphicsFamily, framesInFlight_);
+
+        std::cout << "Uploads via " << (uploader_.dedicatedQueue() ? "dedicated transfer" : "graphics") << " queue\n";
+    }
+
+    void initCompute() {
+        uint32_t computeFamily = deviceCaps_.queueFamilyIndices.computeFamily.value();
+        compute_.init(device_, allocator_, computeFamily, computeQueue_, pipelineCache_);
+
+        std::cout << "Compute jobs via " << (computeFamily != deviceCaps_.queueFamilyIndices.graphicsFamily ? "dedicated compute" : "graphics")
+            << " queue\n";
+    }
+
+    void initPostProcess() {
+        const QueueFamilyIndices & indices = deviceCaps_.queueFamilyIndices;
+
+        // the post-processed image is blitted into the presented one
+        VkFormatProperties props;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice_, swapChainImageFormat_, &props);
+        if(!(props.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT))
+            throw std::runtime_error("The color format doesn't support blits into it, --post needs them");
+
+        post_.init(device_, allocator_, pipelineCache_, loadShaderCode("12_tonemap.comp"), loadShaderCode("13_blur.comp"),
+            indices.graphicsFamily.value(), indices.computeFamily.value(), computeQueue_, graphicsTimeline_,
+            framesInFlight_, swapChainExtent_, options_.blurRadius);
+        post_.setAsync(!options_.postSync);
+
+        std::cout << "Post-process via " << (post_.async() ? "async compute" : "graphics") << " queue\n";
+    }
+
+    // loading starts right away, on the streamer's thread
+    void createTextureStreamer() {
+        textures_.init(device_, physicalDevice_, allocator_, framesInFlight_,
+            VkDeviceSize(std::max(options_.textureBudgetMiB, 1U)) << 20);
+
+        for(const auto & path : options_.texturePaths)
+            sceneTextures_.push_back({ .handle = textures_.load(path) });
+    }
+
+    // the writer waits on the graphics timeline itself, drawFrame() only ever waits on a full ring when headless
+    void createFrameCapture() {
+        frameCapture_.init(device_, allocator_, graphicsTimeline_, *options_.capturePath,
+            std::max(options_.captureSlotCnt, framesInFlight_), options_.headless);
+
+        std::cout << "Capturing frames to " << *options_.capturePath << "\n";
+    }
+
+    // queues the upload, draw the mesh once uploader_.isReady(uploadTicket)
+    Mesh createMesh(const std::vector<Vertex> & _vertices, const std::vector<uint32_t> & _indices) {
+        Mesh mesh;
+        mesh.indexCnt = static_cast<uint32_t>(_indices.size());
+
+        for(const auto & vertex : _vertices)
+            mesh.boundingRadius = std::max(mesh.boundingRadius, std::hypot(vertex.pos[0], vertex.pos[1]));
+
+        VkDeviceSize vertexSz = sizeof(Vertex) * _vertices.size();
+        VkDeviceSize indexSz = sizeof(uint32_t) * _indices.size();
+
+        std::tie(mesh.vertexBuffer, mesh.vertexMemory) = allocator_.createBuffer(vertexSz,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        std::tie(mesh.indexBuffer, mesh.indexMemory) = allocator_.createBuffer(indexSz,
+            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        auto bytes = [](const auto & _vec) {
+            auto data = reinterpret_cast<const char *>(_vec.data());
+            return std::vector<char>(data, data + sizeof(_vec[0]) * _vec.size());
+        };
+
+        uploader_.enqueue(mesh.vertexBuffer, 0, bytes(_vertices),
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+        // uploads complete in order
+        mesh.uploadTicket = uploader_.enqueue(mesh.indexBuffer, 0, bytes(_indices),
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+
+        return mesh;
+    }
+
+    void destroyMesh(Mesh & _mesh) noexcept {
+        if(_mesh.vertexBuffer != VK_NULL_HANDLE)
+            allocator_.destroyBuffer(_mesh.vertexBuffer, _mesh.vertexMemory);
+        if(_mesh.indexBuffer != VK_NULL_HANDLE)
+            allocator_.destroyBuffer(_mesh.indexBuffer, _mesh.indexMemory);
+
+        _mesh = {};
+    }
+
+    void createInstanceBuffers() {
+        // per frame: the cull set of 3 buffers, the graphics pipeline reads instances through bindless_
+        VkDescriptorPoolSize poolSize = {
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 3 * framesInFlight_
+        };
+
+        VkDescriptorPoolCreateInfo poolInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+            .maxSets = framesInFlight_,
+            .poolSizeCount = 1,
+            .pPoolSizes = &poolSize
+        };
+
+        if(vkCreateDescriptorPool(device_, &poolInfo, nullptr, &descriptorPool_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create descriptor pool");
+
+        std::vector<VkDescriptorSet> descriptorSets(framesInFlight_);
+        if(gpuCulling_) {
+            std::vector<VkDescriptorSetLayout> layouts(framesInFlight_, cullSetLayout_);
+
+            VkDescriptorSetAllocateInfo allocInfo = {
+                .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                .descriptorPool = descriptorPool_,
+                .descriptorSetCount = static_cast<uint32_t>(layouts.size()),
+                .pSetLayouts = layouts.data()
+            };
+
+            if(vkAllocateDescriptorSets(device_, &allocInfo, descriptorSets.data()) != VK_SUCCESS)
+                throw std::runtime_error("Failed to allocate descriptor sets");
+        }
+
+        instanceScene_.resize(std::max(options_.instanceCnt, 1U));
+        std::cout << "Scene update: " << instanceScene_.kernelName() << " kernels on " << recordJobs_->threadCnt() << " threads\n";
+
+        frameInstances_.resize(framesInFlight_);
+        for(auto i = 0; i< framesInFlight_; ++i) {
+            if(gpuCulling_) {
+                frameInstances_[i].cullDescriptorSet = descriptorSets[i];
+
+                frameInstances_[i].drawCountBuffer = UniqueBuffer(allocator_, allocator_.createBuffer(
+                    sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+            }
+
+            ensureInstanceCapacity(i, instanceScene_.size());
+            // benchmarkRecording() records without an update
+            frameInstances_[i].visibleCnt = instanceScene_.size();
+        }
+
+        // every slot's set starts out complete, benchmarkRecording() binds one without a frame
+        for(uint32_t i = 0; i< framesInFlight_; ++i)
+            bindless_.flush(i);
+        bindlessSet_ = bindless_.flush(0);
+    }
+
+    // the frame's previous submission must have completed
+    void ensureInstanceCapacity(uint32_t _frame, uint32_t _instanceCnt) {
+        auto & instances = frameInstances_[_frame];
+        if(instances.capacity >= _instanceCnt)
+            return;
+
+        // the old ones go once the slot's last frame is done
+        if(instances.buffer)
+            deletionQueue_.retire(frameSlotValues_[_frame], std::move(instances.buffer));
+
+        instances.capacity = std::max(_instanceCnt, instances.capacity * 2);
+
+        // device-local where the host can write it directly (BAR/ReBAR/UMA), system memory otherwise
+        instances.buffer = UniqueBuffer(allocator_, allocator_.createBuffer(sizeof(InstanceGpu) * instances.capacity,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+
+        // the index stays, only this frame's set gets rewritten before it's bound again
+        if(instances.bindlessIndex == BindlessTable::NONE)
+            instances.bindlessIndex = bindless_.addBuffer(instances.buffer.get());
+        else
+            bindless_.setBuffer(instances.bindlessIndex, instances.buffer.get());
+
+        if(!gpuCulling_)
+            return;
+
+        if(instances.drawBuffer)
+            deletionQueue_.retire(frameSlotValues_[_frame], std::move(instances.drawBuffer));
+
+        instances.drawBuffer = UniqueBuffer(allocator_, allocator_.createBuffer(
+            sizeof(VkDrawIndexedIndirectCommand) * instances.capacity,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+
+        VkDescriptorBufferInfo cullBufferInfos[] = {
+            { .buffer = instances.buffer.get(), .offset = 0, .range = VK_WHOLE_SIZE },
+            { .buffer = instances.drawBuffer.get(), .offset = 0, .range = VK_WHOLE_SIZE },
+            { .buffer = instances.drawCountBuffer.get(), .offset = 0, .range = VK_WHOLE_SIZE }
+        };
+
+        VkWriteDescriptorSet cullWrite = {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = instances.cullDescriptorSet,
+            .dstBinding = 0,
+            .dstArrayElement = 0,
+            .descriptorCount = std::extent_v<decltype(cullBufferInfos)>,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = cullBufferInfos
+        };
+
+        vkUpdateDescriptorSets(device_, 1, &cullWrite, 0, nullptr);
+    }
+
+    // fills the frame's draw buffer with the visible instances, recorded before the render pass
+    void recordCulling(VkCommandBuffer _cmdBuf, const FrameInstances & _instances) noexcept {
+        vkCmdFillBuffer(_cmdBuf, _instances.drawCountBuffer.get(), 0, sizeof(uint32_t), 0);
+
+        VkMemoryBarrier clearBarrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+        };
+        vkCmdPipelineBarrier(_cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+        vkCmdBindPipeline(_cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline_);
+        vkCmdBindDescriptorSets(_cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout_,
+            0, 1, &_instances.cullDescriptorSet, 0, nullptr);
+
+        struct {
+            uint32_t instanceCnt;
+            uint32_t indexCnt;
+            float boundingRadius;
+        } params = { instanceScene_.size(), mesh_.indexCnt, mesh_.boundingRadius };
+        vkCmdPushConstants(_cmdBuf, cullPipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+
+        vkCmdDispatch(_cmdBuf, (instanceScene_.size() + 63) / 64, 1, 1);
+
+        VkMemoryBarrier drawBarrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT
+        };
+        vkCmdPipelineBarrier(_cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+            0, 1, &drawBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    // animates the SoA scene and packs it into the frame's instance buffer, CPU culled unless the GPU culls
+    void updateInstances(uint32_t _frame) {
+        auto start = std::chrono::steady_clock::now();
+
+        // the first frame and long stalls would make everything jump
+        float dt = std::min(std::chrono::duration<float>(start - lastInstanceUpdate_).count(), 0.1F);
+        lastInstanceUpdate_ = start;
+
+        ensureInstanceCapacity(_frame, instanceScene_.size());
+
+        auto & instances = frameInstances_[_frame];
+        float boundingRadius = gpuCulling_ ? std::numeric_limits<float>::infinity() : mesh_.boundingRadius;
+        instances.visibleCnt = instanceScene_.update(dt, boundingRadius, static_cast<InstanceGpu *>(instances.buffer.memory().mapped),
+            *recordJobs_);
+        if(instances.visibleCnt != 0)
+            allocator_.flush(instances.buffer.memory(), 0, sizeof(InstanceGpu) * instances.visibleCnt);
+        instanceVisibleCnt_ = instances.visibleCnt;
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        instanceUpdateMs_ = elapsed.count();
+    }
+
+    // a single set over the whole ring, the range is one FrameUniforms block
+    void createFrameUniforms() {
+        uniformRing_.init(device_, allocator_, deviceCaps_.properties.limits.minUniformBufferOffsetAlignment, framesInFlight_);
+
+        VkDescriptorPoolSize poolSize = {
+            .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            .descriptorCount = 1
+        };
+
+        VkDescriptorPoolCreateInfo poolInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+            .maxSets = 1,
+            .poolSizeCount = 1,
+            .pPoolSizes = &poolSize
+        };
+
+        if(vkCreateDescriptorPool(device_, &poolInfo, nullptr, &uniformPool_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create uniform descriptor pool");
+
+        VkDescriptorSetAllocateInfo allocInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = uniformPool_,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &frameSetLayout_
+        };
+
+        if(vkAllocateDescriptorSets(device_, &allocInfo, &frameSet_) != VK_SUCCESS)
+            throw std::runtime_error("Failed to allocate frame descriptor set");
+
+        writeFrameSet(uniformRing_.buffer());
+
+        // every slot starts out valid, benchmarkRecording() never writes any
+        FrameUniforms uniforms = { .viewScale = { 1.0F, 1.0F } };
+        for(uint32_t i = 0; i< framesInFlight_; ++i) {
+            uniformRing_.begin(i);
+            uniformRing_.push(uniforms);
+        }
+    }
+
+    // picks up texture views that grew since the last frame, then brings the slot's set up to date.
+    // the frame's previous submission must have completed
+    void updateBindless(uint32_t _frame) {
+        for(auto & texture : sceneTextures_) {
+            VkImageView view = textures_.view(texture.handle);
+            if(view == texture.view)
+                continue;
+
+            if(texture.bindlessIndex == BindlessTable::NONE)
+                texture.bindlessIndex = bindless_.addImage(view);
+            else
+                bindless_.setImage(texture.bindlessIndex, view);
+            texture.view = view;
+        }
+
+        bindlessSet_ = bindless_.flush(_frame);
+    }
+
+    // no submitted frame may still use frameSet_
+    void writeFrameSet(VkBuffer _ring) {
+        VkDescriptorBufferInfo bufferInfo = {
+            .buffer = _ring,
+            .offset = 0,
+            .range = sizeof(FrameUniforms)
+        };
+
+        VkWriteDescriptorSet descriptorWrite = {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = frameSet_,
+            .dstBinding = 0,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            .pBufferInfo = &bufferInfo
+        };
+
+        vkUpdateDescriptorSets(device_, 1, &descriptorWrite, 0, nullptr);
+    }
+
+    // the frame's previous submission must have completed
+    void updateFrameUniforms(uint32_t _frame) {
+        auto now = std::chrono::steady_clock::now();
+        if(frameCnt_ == 0)
+            firstFrame_ = lastFrame_ = now;
+
+        // the identity view for now, the cull pass tests instances in the same space
+        FrameUniforms uniforms = {
+            .viewOffset = { 0.0F, 0.0F },
+            .viewScale = { 1.0F, 1.0F },
+            .time = std::chrono::duration<float>(now - firstFrame_).count(),
+            .deltaTime = std::chrono::duration<float>(now - lastFrame_).count()
+        };
+        lastFrame_ = now;
+
+        uniformRing_.begin(_frame);
+        frameUniformOffset_ = uniformRing_.push(uniforms);
+    }
+
+    void createSceneMesh() {
+        uint32_t gridSz = options_.meshGridSize;
+
+        if(gridSz == 0) {
+            mesh_ = createMesh({
+                { { 0.0F, -0.5F }, { 1.0F, 0.0F, 0.0F } },
+                { { 0.5F, 0.5F }, { 0.0F, 1.0F, 0.0F } },
+                { { -0.5F, 0.5F }, { 0.0F, 0.0F, 1.0F } }
+            }, { 0, 1, 2 });
+            return;
+        }
+
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        vertices.reserve(size_t(gridSz + 1) * (gridSz + 1));
+        indices.reserve(size_t(gridSz) * gridSz * 6);
+
+        for(uint32_t y = 0; y<= gridSz; ++y) {
+            for(uint32_t x = 0; x<= gridSz; ++x) {
+                float u = float(x) / gridSz, v = float(y) / gridSz;
+                vertices.push_back({ { u * 1.8F - 0.9F, v * 1.8F - 0.9F }, { u, v, 1.0F - u } });
+            }
+        }
+
+        // clockwise with y pointing down, like the pipeline's front face
+        for(uint32_t y = 0; y< gridSz; ++y) {
+            for(uint32_t x = 0; x< gridSz; ++x) {
+                uint32_t topLeft = y * (gridSz + 1) + x;
+                uint32_t bottomLeft = topLeft + gridSz + 1;
+
+                indices.insert(indices.end(), { topLeft, topLeft + 1, bottomLeft + 1, topLeft, bottomLeft + 1, bottomLeft });
+            }
+        }
+
+        mesh_ = createMesh(vertices, indices);
+    }
+
+    void drawFrame() {
+        // the slot's previous frame must be done before its resources are reused
+        double cpuWaitMs = waitForFrame(frameSlotValues_[currentFrame_]);
+
+        // the compute queue may still read the slot's scene image
+        if(options_.postProcess) {
+            cpuWaitMs += post_.waitSlot(currentFrame_);
+            post_.releaseRetired();
+        }
+
+        deletionQueue_.collect();
+        installPipelines();
+
+        // the frame's previous submission is done, so are its queries
+        gpuProfiler_.collect(currentFrame_);
+
+        uint32_t imageIndex;
+        if(options_.headless)
+            imageIndex = currentFrame_;
+        else {
+            auto res = vkAcquireNextImageKHR(device_, swapChain_.get(), UINT64_MAX, imageAvailableSemaphores_[currentFrame_], VK_NULL_HANDLE, &imageIndex);
+
+            // the semaphore is left unsignaled and nothing was submitted, so just try again next frame
+            if(res == VK_ERROR_OUT_OF_DATE_KHR) {
+                recreateSwapChain();
+                return;
+            } else if(res != VK_SUCCESS && res != VK_SUBOPTIMAL_KHR)
+                throw std::runtime_error("Failed to acquire swapchain image");
+        }
+
+        // the image may come back while an older frame still renders into it
+        cpuWaitMs += waitForFrame(imageFrameValues_[imageIndex]);
+
+        cpuWaitHistory_[cpuWaitHead_] = cpuWaitMs;
+        cpuWaitHead_ = (cpuWaitHead_ + 1) % cpuWaitHistory_.size();
+        cpuWaitCnt_ = std::min(cpuWaitCnt_ + 1, cpuWaitHistory_.size());
+
+        updateInstances(currentFrame_);
+        updateFrameUniforms(currentFrame_);
+        updateBindless(currentFrame_);
+
+        // all of this frame's uploads in one transfer submit, ahead of the graphics submit waiting on it
+        auto uploads = uploader_.flush(currentFrame_);
+
+        recordFrame(currentFrame_, imageIndex);
+
+        VkSubmitInfo submitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        };
+
+        // values of binary semaphores are ignored
+        std::vector<VkSemaphore> waitSemaphores;
+        std::vector<VkPipelineStageFlags> waitStages;
+        std::vector<uint64_t> waitValues;
+
+        // nothing is acquired headless
+        if(!options_.headless) {
+            waitSemaphores.push_back(imageAvailableSemaphores_[currentFrame_]);
+            // post-processing renders elsewhere and only blits into the image
+            waitStages.push_back(options_.postProcess ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+            waitValues.push_back(0);
+        }
+
+        // the previous frame's passes on the compute queue, blitted by this one
+        if(options_.postProcess && postWait_.semaphore != VK_NULL_HANDLE) {
+            waitSemaphores.push_back(postWait_.semaphore);
+            waitStages.push_back(postWait_.stage);
+            waitValues.push_back(postWait_.value);
+        }
+
+        if(uploads.semaphore != VK_NULL_HANDLE) {
+            waitSemaphores.push_back(uploads.semaphore);
+            waitStages.push_back(uploads.waitStage);
+            waitValues.push_back(uploads.value);
+        }
+
+        submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+        submitInfo.pWaitSemaphores = waitSemaphores.data();
+        submitInfo.pWaitDstStageMask = waitStages.data();
+
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &frameCommands_[currentFrame_].primary;
+
+        uint64_t frameValue = frameCnt_ + 1;
+
+        VkSemaphore signalSemaphores[] = { graphicsTimeline_, renderFinishedSemaphores_[currentFrame_] };
+        uint64_t signalValues[] = { frameValue, 0 };
+        submitInfo.signalSemaphoreCount = std::extent_v<decltype(signalSemaphores)>;
+        submitInfo.pSignalSemaphores = signalSemaphores;
+
+        // nothing is presented
+        if(options_.headless)
+            submitInfo.signalSemaphoreCount = 1;
+
+        VkTimelineSemaphoreSubmitInfo timelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .waitSemaphoreValueCount = submitInfo.waitSemaphoreCount,
+            .pWaitSemaphoreValues = waitValues.data(),
+            .signalSemaphoreValueCount = submitInfo.signalSemaphoreCount,
+            .pSignalSemaphoreValues = signalValues
+        };
+        submitInfo.pNext = &timelineInfo;
+
+        if(vkQueueSubmit(graphicsQueue_, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+            throw std::runtime_error("Failed to submit draw command buffer");
+
+        frameSlotValues_[currentFrame_] = frameValue;
+        imageFrameValues_[imageIndex] = frameValue;
+
+        frameCapture_.submitted(frameValue);
+        if(options_.postProcess)
+            post_.submitted(frameValue);
+
+        lastImageIndex_ = imageIndex;
+        ++frameCnt_;
+
+        gpuProfiler_.submitted(currentFrame_);
+        if(gpuProfiler_.shouldLog()) {
+            logGpuFrameStats();
+            logCpuWaitStats();
+        }
+
+        if(options_.headless) {
+            currentFrame_ = (currentFrame_ + 1) % framesInFlight_;
+            return;
+        }
+
+        VkPresentInfoKHR presentInfo = {
+            .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+
+            .waitSemaphoreCount = 1,
+            .pWaitSemaphores = &renderFinishedSemaphores_[currentFrame_]
+        };
+
+        VkSwapchainKHR swapChains[] = { swapChain_.get() };
+
+        presentInfo.swapchainCount = std::extent_v<decltype(swapChains)>;
+        presentInfo.pSwapchains = swapChains;
+
+        presentInfo.pImageIndices = &imageIndex;
+
+        auto res = vkQueuePresentKHR(presentQueue_, &presentInfo);
+
+        currentFrame_ = (currentFrame_ + 1) % framesInFlight_;
+
+        if(res == VK_ERROR_OUT_OF_DATE_KHR || res == VK_SUBOPTIMAL_KHR || frameBufferResized_) {
+            frameBufferResized_ = false;
+            recreateSwapChain();
+        } else if(res != VK_SUCCESS)
+            throw std::runtime_error("Failed to present swapchain image");
+    }
+
+    void logGpuFrameStats() const {
+        if(!gpuProfiler_.enabled())
+            return;
+
+        auto stats = gpuProfiler_.stats();
+        std::cout << "GPU frame: min " << stats.minMs << " ms, avg " << stats.avgMs
+            << " ms, p99 " << stats.p99Ms << " ms (" << stats.sampleCnt << " frames)"
+            << ", VS invocations " << stats.vertexInvocations
+            << ", FS invocations " << stats.fragmentInvocations << "\n";
+    }
+
+    void logCpuWaitStats() const {
+        if(cpuWaitCnt_ == 0)
+            return;
+
+        std::vector<double> samples(cpuWaitHistory_.begin(), cpuWaitHistory_.begin() + cpuWaitCnt_);
+
+        double sum = 0.0;
+        for(auto sample : samples)
+            sum += sample;
+
+        auto p99 = samples.begin() + (samples.size() - 1) * 99 / 100;
+        std::nth_element(samples.begin(), p99, samples.end());
+
+        std::cout << "CPU wait in drawFrame: avg " << sum / samples.size() << " ms, p99 " << *p99
+            << " ms (" << framesInFlight_ << " frame(s) in flight, " << samples.size() << " frames)\n";
+    }
+
+    // embedded SPIR-V unless overridden by --shader-dir
+    std::vector<uint32_t> loadShaderCode(std::string_view _name) {
+        // glslc -w -x glsl --target-env=vulkan1.1 -O (filename).(frag/vert) -o (filename).(frag/vert).spv
+        if(options_.shaderDir)
+            return readSpirvFile(*options_.shaderDir + "/" + std::string(_name) + ".spv");
+
+        auto code = findEmbeddedShader(_name);
+        if(code.empty())
+            throw std::runtime_error("No embedded shader named \"" + std::string(_name) + "\"");
+
+        return { code.begin(), code.end() };
+    }
+
+    VkShaderModule createShaderModule(std::string_view _name) {
+        auto code = loadShaderCode(_name);
+        return createShaderModule(std::span<const uint32_t>(code));
+    }
+
+    VkShaderModule createShaderModule(std::span<const uint32_t> code) {
+        VkShaderModuleCreateInfo createInfo = {
+            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+            .codeSize = code.size_bytes(),
+            .pCode = code.data()
+        };
+
+        VkShaderModule shaderModule;
+        if(vkCreateShaderModule(device_, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create shader module");
+        
+        return shaderModule;
+    }
+
+    // of the swapchain images or the offscreen targets, createSwapChain() picks the same
+    VkFormat chooseColorFormat() noexcept {
+        if(options_.headless)
+            return VK_FORMAT_R8G8B8A8_UNORM;
+
+        return chooseSwapSurfaceFormat(deviceCaps_.surfaceFormats).format;
+    }
 
     VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR> & availableFormats) noexcept {
         for(const auto & format : availableFormats) {
@@ -769,97 +2588,166 @@ private:
         return actualExtent;
     }
 
-    SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice _device) noexcept {
-        SwapChainSupportDetails details;
+    // formats and present modes come from the device snapshot, the capabilities follow the window size
+    SwapChainSupportDetails querySwapChainSupport() noexcept {
+        SwapChainSupportDetails details = {
+            .formats = deviceCaps_.surfaceFormats,
+            .presentModes = deviceCaps_.presentModes
+        };
 
-        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(_device, surface_, &details.capabilities);
+        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice_, surface_, &details.capabilities);
 
-        uint32_t formatCnt;
-        vkGetPhysicalDeviceSurfaceFormatsKHR(_device, surface_, &formatCnt, nullptr);
+        return details;
+    }
 
-        if(formatCnt != 0) {
-            details.formats.resize(formatCnt);
-            vkGetPhysicalDeviceSurfaceFormatsKHR(_device, surface_, &formatCnt, details.formats.data());
-        }
+    bool isDeviceSuitable(const DeviceCapabilities & _caps) noexcept {
+        bool extensionsSupported = _caps.supportsExtensions(getRequiredDeviceExtensions());
 
-        uint32_t presentModeCnt;
-        vkGetPhysicalDeviceSurfacePresentModesKHR(_device, surface_, &presentModeCnt, nullptr);
+        bool swapChainAdequate = options_.headless
+            || (!_caps.surfaceFormats.empty() && !_caps.presentModes.empty());
 
-        if(presentModeCnt != 0) {
-            details.presentModes.resize(presentModeCnt);
-            vkGetPhysicalDeviceSurfacePresentModesKHR(_device, surface_, &presentModeCnt, details.presentModes.data());
-        }
+        // frame pacing runs on timeline semaphores
+        return _caps.queueFamilyIndices.isComplete() && extensionsSupported && swapChainAdequate
+            && _caps.features12.timelineSemaphore && hasBindlessFeatures(_caps);
+    }
 
-        return details;
+    // VS/FS invocation counts, without inheritedQueries they're dropped
+    bool hasPipelineStatistics() const noexcept {
+        return deviceCaps_.features.pipelineStatisticsQuery && deviceCaps_.features.inheritedQueries;
     }
 
-    bool isDeviceSuitable(VkPhysicalDevice _device) noexcept {
-        QueueFamilyIndices indices = findQueueFamilies(_device);
+    // the graphics pipeline reads every instance buffer and texture through BindlessTable
+    // indexed with push constants, so dynamically uniform indexing of both arrays
+    static bool hasBindlessFeatures(const DeviceCapabilities & _caps) noexcept {
+        const auto & features12 = _caps.features12;
+        return features12.runtimeDescriptorArray && features12.descriptorBindingPartiallyBound
+            && features12.descriptorBindingSampledImageUpdateAfterBind && features12.descriptorBindingStorageBufferUpdateAfterBind
+            && _caps.features.shaderStorageBufferArrayDynamicIndexing && _caps.features.shaderSampledImageArrayDynamicIndexing;
+    }
 
-        bool extensionsSupported = checkDeviceExtensionSupport(_device);
+    std::vector<const char *> getRequiredExtensions() noexcept {
+        std::vector<const char *> extensions;
 
-        bool swapChainAdequate = false;
-        if(extensionsSupported) {
-            SwapChainSupportDetails swapChainSupport = querySwapChainSupport(_device);
-            swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+        if(!options_.headless) {
+            uint glfwExtensionCnt = 0;
+            const char ** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCnt);
+
+            extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCnt);
         }
 
-        return indices.isComplete() && extensionsSupported && swapChainAdequate;
+#ifndef NDEBUG
+        extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+#endif
+        return extensions;
     }
 
-    bool checkDeviceExtensionSupport(VkPhysicalDevice _device) noexcept {
-        uint32_t extensionCnt;
-        vkEnumerateDeviceExtensionProperties(_device, nullptr, &extensionCnt, nullptr);
+    std::vector<const char *> getRequiredDeviceExtensions() noexcept {
+        if(options_.headless)
+            return {};
 
-        std::vector<VkExtensionProperties> availableExts(extensionCnt);
-        vkEnumerateDeviceExtensionProperties(_device, nullptr, &extensionCnt, availableExts.data());
+        return __deviceExts;
+    }
 
-        std::set<std::string> requiredExtensions(__deviceExts.begin(), __deviceExts.end());
+    // copies a headless target (left in TRANSFER_SRC_OPTIMAL by the render pass) into a binary PPM
+    void readbackImage(uint32_t _imageIndex, const std::string & _filename) {
+        const VkDeviceSize bufSz = VkDeviceSize(swapChainExtent_.width) * swapChainExtent_.height * 4;
 
-        for(const auto & ext : availableExts)
-            requiredExtensions.erase(ext.extensionName);
-            
-        return requiredExtensions.empty();
-    }
+        // cached memory makes the CPU side of the copy a lot faster where available
+        auto [buffer, memory] = allocator_.createBuffer(bufSz, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
 
-    QueueFamilyIndices findQueueFamilies(VkPhysicalDevice _device) noexcept {
-        QueueFamilyIndices indices;
+        VkCommandBufferAllocateInfo cmdAllocInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = commandPool_,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1
+        };
 
-        uint32_t queueFamilyCnt = 0;
-        vkGetPhysicalDeviceQueueFamilyProperties(_device, &queueFamilyCnt, nullptr);
+        VkCommandBuffer cmdBuf;
+        if(vkAllocateCommandBuffers(device_, &cmdAllocInfo, &cmdBuf) != VK_SUCCESS)
+            throw std::runtime_error("Failed to allocate readback command buffer");
 
-        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCnt);
-        vkGetPhysicalDeviceQueueFamilyProperties(_device, &queueFamilyCnt, queueFamilies.data());
+        VkCommandBufferBeginInfo beginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+        };
+        vkBeginCommandBuffer(cmdBuf, &beginInfo);
+
+        VkImageMemoryBarrier toTransfer = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = swapChainImages_[_imageIndex],
+            .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+        };
+        vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &toTransfer);
+
+        VkBufferImageCopy region = {
+            .bufferOffset = 0,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+            .imageOffset = { 0, 0, 0 },
+            .imageExtent = { swapChainExtent_.width, swapChainExtent_.height, 1 }
+        };
+        vkCmdCopyImageToBuffer(cmdBuf, swapChainImages_[_imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, &region);
+
+        VkBufferMemoryBarrier toHost = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = buffer,
+            .offset = 0,
+            .size = VK_WHOLE_SIZE
+        };
+        vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+            0, 0, nullptr, 1, &toHost, 0, nullptr);
 
-        auto i = 0;
-        for(const auto & queueFamily : queueFamilies) {
-            if(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
-                indices.graphicsFamily = i;
-            
-            VkBool32 presentSupport = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(_device, i, surface_, &presentSupport);
+        vkEndCommandBuffer(cmdBuf);
 
-            if(presentSupport)
-                indices.presentFamily = i;
-            
-            if(indices.isComplete()) break;
+        VkSubmitInfo submitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &cmdBuf
+        };
 
-            ++i;
-        }
+        if(vkQueueSubmit(graphicsQueue_, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+            throw std::runtime_error("Failed to submit readback command buffer");
+        vkQueueWaitIdle(graphicsQueue_);
 
-        return indices;
-    }
+        allocator_.invalidate(memory);
+        void * data = memory.mapped;
 
-    std::vector<const char *> getRequiredExtensions() noexcept {
-        uint glfwExtensionCnt = 0;
-        const char ** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCnt);
+        std::ofstream file(_filename, std::ios::binary);
+        if(!file.is_open())
+            throw std::runtime_error("Failed to open file(\"" + _filename + "\")");
 
-        std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCnt);
+        file << "P6\n" << swapChainExtent_.width << ' ' << swapChainExtent_.height << "\n255\n";
+
+        // RGBA -> RGB, a row at a time
+        auto pixels = static_cast<const uint8_t *>(data);
+        std::vector<char> row(swapChainExtent_.width * 3);
+        for(uint32_t y = 0; y< swapChainExtent_.height; ++y) {
+            for(uint32_t x = 0; x< swapChainExtent_.width; ++x) {
+                auto px = pixels + (VkDeviceSize(y) * swapChainExtent_.width + x) * 4;
+                row[x * 3 + 0] = px[0];
+                row[x * 3 + 1] = px[1];
+                row[x * 3 + 2] = px[2];
+            }
+            file.write(row.data(), row.size());
+        }
 
-#ifndef NDEBUG
-        extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
-#endif
-        return extensions;
+        vkFreeCommandBuffers(device_, commandPool_, 1, &cmdBuf);
+        allocator_.destroyBuffer(buffer, memory);
+
+        std::cout << "Wrote " << _filename << "\n";
     }
 
     bool checkValidationLayerSupport() noexcept {
@@ -887,37 +2775,163 @@ private:
         return true;
     }
 
-    static std::vector<char> readFile(const std::string & _filename) {
+    // read into words, so pCode is properly aligned
+    static std::vector<uint32_t> readSpirvFile(const std::string & _filename) {
         std::ifstream file(_filename, std::ios::ate | std::ios::binary);
 
         if(!file.is_open())
             throw std::runtime_error("Failed to open file(\"" + _filename + "\")");
         
         std::size_t fileSz = (std::size_t)file.tellg();
-        std::vector<char> buf(fileSz);
+        if(fileSz % sizeof(uint32_t) != 0)
+            throw std::runtime_error("Invalid SPIR-V size(\"" + _filename + "\")");
+
+        std::vector<uint32_t> buf(fileSz / sizeof(uint32_t));
 
         file.seekg(0);
-        file.read(buf.data(), fileSz);
+        file.read(reinterpret_cast<char *>(buf.data()), fileSz);
 
         file.close();
 
         return buf;
     }
+};
 
-    static VKAPI_ATTR VkBool32 VKAPI_CALL _debugCallBack(VkDebugUtilsMessageSeverityFlagBitsEXT _msgSeverity,
-        VkDebugUtilsMessageTypeFlagsEXT _msgType,
-        const VkDebugUtilsMessengerCallbackDataEXT * _cb_data,
-        void * _usr_data) noexcept {
-        ;
-        std::cerr << "Validation layer: " << _cb_data->pMessage << std::endl;
+auto main(int argc, char * argv[]) -> int32_t {
+    int width = 800, height = 600;
+    ProgramOptions options;
+
+    auto printUsage = [&] {
+        std::cerr << "Usage: " << argv[0] << " [--headless] [--frames N] [--frames-in-flight N] [--extent WxH] [--readback out.ppm] [--pipeline-cache path] [--shader-dir dir]\n"
+            << "    [--draws N] [--record-threads N] [--pipeline-threads N] [--bench-record N] [--bench-uniforms N] [--grid N]\n"
+            << "    [--instances N] [--bench-instances] [--gpu-cull] [--compute-test N] [--startup-json out.json]\n"
+            << "    [--validation-level verbose|info|warning|error] [--no-perf-warnings] [--depth] [--msaa N]\n"
+            << "    [--capture out.ppm] [--capture-slots N] [--texture file.ktx2]... [--texture-budget MiB]\n"
+            << "    [--post] [--post-sync] [--blur N] [--bench-post]\n";
+    };
+
+    // std::stoul()/std::stoi() throw on a value that isn't a number or doesn't fit
+    std::string arg;
+    try {
+        for(auto i = 1; i< argc; ++i) {
+            arg = argv[i];
+            bool hasValue = i + 1 < argc;
+
+            if(arg == "--headless")
+                options.headless = true;
+            else if(arg == "--frames" && hasValue)
+                options.frameCnt = std::stoul(argv[++i]);
+            else if(arg == "--extent" && hasValue) {
+                // WxH
+                std::string extent = argv[++i];
+                auto x = extent.find('x');
+                if(x == std::string::npos) {
+                    std::cerr << "Invalid extent \"" << extent << "\", expected WxH\n";
+                    return -1;
+                }
+                width = std::stoi(extent.substr(0, x));
+                height = std::stoi(extent.substr(x + 1));
+            } else if(arg == "--readback" && hasValue)
+                options.readbackPath = argv[++i];
+            else if(arg == "--texture" && hasValue)
+                options.texturePaths.push_back(argv[++i]);
+            else if(arg == "--texture-budget" && hasValue)
+                options.textureBudgetMiB = std::stoul(argv[++i]);
+            else if(arg == "--capture" && hasValue)
+                options.capturePath = argv[++i];
+            else if(arg == "--capture-slots" && hasValue)
+                options.captureSlotCnt = std::stoul(argv[++i]);
+            else if(arg == "--frames-in-flight" && hasValue)
+                options.framesInFlight = std::stoul(argv[++i]);
+            else if(arg == "--pipeline-cache" && hasValue)
+                options.pipelineCachePath = argv[++i];
+            else if(arg == "--shader-dir" && hasValue)
+                options.shaderDir = argv[++i];
+            else if(arg == "--draws" && hasValue)
+                options.drawCnt = std::stoul(argv[++i]);
+            else if(arg == "--record-threads" && hasValue)
+                options.recordThreadCnt = std::stoul(argv[++i]);
+            else if(arg == "--pipeline-threads" && hasValue)
+                options.pipelineThreadCnt = std::stoul(argv[++i]);
+            else if(arg == "--bench-record" && hasValue)
+                options.benchRecordDrawCnt = std::stoul(argv[++i]);
+            else if(arg == "--bench-uniforms" && hasValue)
+                options.benchUniformDrawCnt = std::stoul(argv[++i]);
+            else if(arg == "--grid" && hasValue)
+                options.meshGridSize = std::stoul(argv[++i]);
+            else if(arg == "--instances" && hasValue)
+                options.instanceCnt = std::max(std::stoul(argv[++i]), 1UL);
+            else if(arg == "--bench-instances")
+                options.benchInstances = true;
+            else if(arg == "--compute-test" && hasValue)
+                options.computeTestCnt = std::stoul(argv[++i]);
+            else if(arg == "--gpu-cull")
+                options.gpuCulling = true;
+            else if(arg == "--post")
+                options.postProcess = true;
+            else if(arg == "--post-sync")
+                options.postProcess = options.postSync = true;
+            else if(arg == "--blur" && hasValue)
+                options.blurRadius = std::stoul(argv[++i]);
+            else if(arg == "--bench-post")
+                options.postProcess = options.benchPost = true;
+            else if(arg == "--depth")
+                options.depth = true;
+            else if(arg == "--msaa" && hasValue)
+                options.msaaSamples = std::max(std::stoul(argv[++i]), 1UL);
+            else if(arg == "--startup-json" && hasValue)
+                options.startupJsonPath = argv[++i];
+            else if(arg == "--validation-level" && hasValue) {
+                // the level and everything more severe
+                std::string level = argv[++i];
+                VkDebugUtilsMessageSeverityFlagsEXT severities = VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+                if(level == "verbose")
+                    severities |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT
+                        | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+                else if(level == "info")
+                    severities |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+                else if(level == "warning")
+                    severities |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+                else if(level != "error") {
+                    std::cerr << "Invalid validation level \"" << level << "\", expected verbose, info, warning or error\n";
+                    return -1;
+                }
+                options.validationSeverities = severities;
+            } else if(arg == "--no-perf-warnings")
+                options.validationTypes &= ~VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+            else {
+                std::cerr << "Unknown option \"" << arg << "\"\n";
+                printUsage();
+                return -1;
+            }
+        }
+    } catch(const std::logic_error &) {
+        std::cerr << "Invalid value for \"" << arg << "\"\n";
+        printUsage();
+        return -1;
+    }
 
-        return VK_FALSE;
+    if(width <= 0 || height <= 0) {
+        std::cerr << "Invalid extent " << width << "x" << height << ", both sizes must be positive\n";
+        return -1;
     }
-};
 
-auto main(int argc, char * argv[]) -> int32_t {
-    
-    VkProgram program(800, 600, "Simple Vulkan program");
+    if(options.framesInFlight == 0 || options.captureSlotCnt == 0) {
+        std::cerr << "--frames-in-flight and --capture-slots must be at least 1\n";
+        return -1;
+    }
+
+    if(!options.shaderDir) {
+        if(auto shaderDir = std::getenv("VKTEST_SHADER_DIR"))
+            options.shaderDir = shaderDir;
+    }
+
+    if(options.readbackPath && !options.headless) {
+        std::cerr << "--readback requires --headless\n";
+        return -1;
+    }
+
+    VkProgram program(width, height, "Simple Vulkan program", std::move(options));
 
     try {
         program.run();